@@ -3,240 +3,2425 @@
 #include <fstream>
 #include <cassert>
 #include <random>
+#include <string>
+#include <string_view>
+#include <array>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <sstream>
+#include <set>
+#include <map>
+#include <cstdlib>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using std::vector; 
 
+constexpr uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max(); 
+
+uint64_t AddModMersenne(const uint64_t first, const uint64_t second); 
+uint64_t MultiplyModMersenne(const uint64_t first, const uint64_t second); 
+uint64_t HashBytes(const char* data, const size_t length, const uint64_t point); 
+uint64_t ImageChecksum(const char* data, const size_t length); 
+
+// KeyHasher<Key> turns a key into a residue modulo HashFunction::kBigPrime: the key is read
+// as a sequence of 32-bit words which are evaluated as a polynomial at a random point, so two
+// distinct keys of at most L words collide with probability at most L / kBigPrime.
+// Specialize it to make the sets accept a new key type. A set draws one point for all its
+// keys and reduces a key once per lookup; every HashFunction of the set then works on the
+// residue. Distinct keys with equal residues would collide on every level, so a build which
+// meets them draws a new point.
+template <class Key, class Enable = void>
+struct KeyHasher; 
+
+template <class Key>
+struct KeyHasher<Key, typename std::enable_if<std::is_integral<Key>::value>::type> { 
+    uint64_t operator() (const Key key, const uint64_t point) const; 
+}; 
+
+template <>
+struct KeyHasher<std::string_view> { 
+    uint64_t operator() (const std::string_view key, const uint64_t point) const { 
+        return HashBytes(key.data(), key.size(), point); 
+    }
+}; 
+
+template <size_t N>
+struct KeyHasher<std::array<uint8_t, N>> { 
+    uint64_t operator() (const std::array<uint8_t, N>& key, const uint64_t point) const { 
+        return HashBytes(reinterpret_cast<const char*>(key.data()), N, point); 
+    }
+}; 
+
+// Fixed-size byte keys such as 128-bit UUIDs.
+template <size_t N>
+using ByteKey = std::array<uint8_t, N>; 
+
+// ((first * residue + second) mod kBigPrime) mod size of a residue from KeyHasher.
 class HashFunction { 
     private:
         uint64_t first_coeff_; 
         uint64_t second_coeff_; 
         uint64_t table_size_; 
-        uint64_t prime_modulo_; 
 
     public:
-        static constexpr uint64_t kBigPrime = 214783647;
-        uint64_t operator() (const int key) const; 
+        static constexpr uint64_t kBigPrime = (static_cast<uint64_t>(1) << 61) - 1; 
+        uint64_t operator() (const uint64_t residue) const; 
         const uint64_t size() const; 
         template <class RandomGenerator>
         static HashFunction MakeRandom(const uint64_t size,
-                                       RandomGenerator& random_numbers_generator, 
-                                       const uint64_t prime_modulo = kBigPrime); 
-        HashFunction(const uint64_t first, const uint64_t second, const uint64_t size, 
-                     const uint64_t modulo);
+                                       RandomGenerator& random_numbers_generator); 
+        // A point for KeyHasher.
+        template <class RandomGenerator>
+        static uint64_t MakeRandomPoint(RandomGenerator& random_numbers_generator); 
+        HashFunction(const uint64_t first, const uint64_t second, const uint64_t size); 
         HashFunction() {} 
 }; 
 
-template <class T, class HashFunctionClass>
+// Read-only contiguous array which either owns its elements or refers to memory owned by
+// someone else, such as a mapped image (see FixedSet::Load).
+template <class T> 
+class FlatArray { 
+    public:
+        FlatArray() : data_(nullptr), size_(0) {}
+        FlatArray(const FlatArray& other) { *this = other; }
+        FlatArray(FlatArray&& other) = default; 
+        FlatArray& operator= (const FlatArray& other); 
+        FlatArray& operator= (FlatArray&& other) = default; 
+        void Assign(vector<T>&& elements); 
+        void Refer(const T* data, const size_t size); 
+        // Copies referred elements into memory of its own, allocated by the calling thread.
+        void Localize(); 
+        const T& operator[] (const size_t index) const { return data_[index]; }
+        const T* data() const { return data_; }
+        size_t size() const { return size_; }
+        size_t Bytes() const { return size_ * sizeof(T); }
+        bool empty() const { return size_ == 0; }
+    private:
+        vector<T> owned_; 
+        const T* data_; 
+        size_t size_; 
+}; 
+
+// Image sections: a 64-bit byte length followed by the bytes, padded to 8 bytes so that
+// every array in a mapped image stays aligned.
+class ImageWriter { 
+    public:
+        template <class E>
+        void WriteArray(const FlatArray<E>& array) { 
+            WriteSection(array.data(), array.size() * sizeof(E)); 
+        }
+        template <class E>
+        void WriteValue(const E& value) { WriteSection(&value, sizeof(E)); }
+        const vector<char>& Buffer() const { return buffer_; }
+    private:
+        void WriteSection(const void* data, const uint64_t length); 
+        vector<char> buffer_; 
+}; 
+
+class ImageReader { 
+    public:
+        ImageReader(const char* data, const size_t size) : data_(data), size_(size), position_(0) {}
+        template <class E>
+        bool ReadArray(FlatArray<E>& array); 
+        template <class E>
+        bool ReadValue(E& value); 
+    private:
+        const char* ReadSection(uint64_t& length); 
+        const char* data_; 
+        size_t size_; 
+        size_t position_; 
+}; 
+
+// Read-only shared mapping of a whole file, unmapped on destruction.
+class MappedFile { 
+    public:
+        MappedFile() : data_(nullptr), size_(0) {}
+        ~MappedFile(); 
+        MappedFile(const MappedFile&) = delete; 
+        MappedFile& operator= (const MappedFile&) = delete; 
+        bool Open(const std::string& path); 
+        // Maps the file behind an open descriptor; the descriptor stays open.
+        bool Map(const int descriptor); 
+        const char* Data() const { return data_; }
+        size_t Size() const { return size_; }
+    private:
+        const char* data_; 
+        size_t size_; 
+}; 
+
+// Bulk reader of whitespace-separated integers: maps the input when it is a regular file and
+// otherwise read()s it in kBlockSize blocks, so parsing never goes through an istream.
+class FastInput { 
+    public:
+        explicit FastInput(const int descriptor); 
+        FastInput(const FastInput&) = delete; 
+        FastInput& operator= (const FastInput&) = delete; 
+        // Reads an optionally signed decimal integer. Returns false at the end of the input, and
+        // on a token which doesn't start like one, which it skips.
+        template <class Integer>
+        bool ReadInteger(Integer& value); 
+    private:
+        bool Refill(); 
+        // Consumes the rest of a token which isn't an integer.
+        void SkipToken(); 
+        int descriptor_; 
+        MappedFile mapping_; 
+        vector<char> buffer_; 
+        const char* position_; 
+        const char* end_; 
+        bool exhausted_; 
+        static constexpr size_t kBlockSize = 1 << 20; 
+        static constexpr ptrdiff_t kMaxTokenLength = 32; 
+}; 
+
+// Buffered writer which hands the output to write() in kBlockSize pieces.
+class FastOutput { 
+    public:
+        explicit FastOutput(const int descriptor) : descriptor_(descriptor) {}
+        ~FastOutput() { Flush(); }
+        FastOutput(const FastOutput&) = delete; 
+        FastOutput& operator= (const FastOutput&) = delete; 
+        void Write(const char* data, const size_t length); 
+        void Flush(); 
+    private:
+        int descriptor_; 
+        vector<char> buffer_; 
+        static constexpr size_t kBlockSize = 1 << 20; 
+}; 
+
+// Bounded queue handing chunks from one pipeline stage to the next.
+template <class E>
+class ChunkQueue { 
+    public:
+        explicit ChunkQueue(const size_t capacity) : capacity_(capacity), closed_(false) {}
+        void Push(E&& element); 
+        // No more elements will be pushed.
+        void Close(); 
+        // Returns false once the queue is closed and drained.
+        bool Pop(E& element); 
+    private:
+        std::mutex mutex_; 
+        std::condition_variable not_empty_; 
+        std::condition_variable not_full_; 
+        std::deque<E> elements_; 
+        size_t capacity_; 
+        bool closed_; 
+}; 
+
+// The key type of an image, which key_size alone doesn't tell: int and ByteKey<4> keys are
+// both four bytes long.
+enum class ImageKeyKind : uint32_t { kSignedInteger = 1, kUnsignedInteger, kFloatingPoint, kBytes, kString }; 
+
+template <class T> 
+constexpr ImageKeyKind KeyKindOf() { 
+    return std::is_floating_point<T>::value ? ImageKeyKind::kFloatingPoint :
+           !std::is_integral<T>::value ? ImageKeyKind::kBytes :
+           std::is_signed<T>::value ? ImageKeyKind::kSignedInteger : ImageKeyKind::kUnsignedInteger; 
+}
+
+// Native-endian, so an image is only portable between machines of the same byte order.
+struct ImageHeader { 
+    char magic[8]; 
+    uint32_t version; 
+    uint32_t key_size; 
+    ImageKeyKind key_kind; 
+    uint32_t reserved; 
+    uint64_t function_size; 
+    uint64_t payload_size; 
+    uint64_t checksum; 
+}; 
+
+// KeyStorage<T> keeps the keys of a FixedSet densely, in the order of their slots.
+// LookupKey is the type Contains accepts and KeyHasher is instantiated with.
+template <class T> 
+class KeyStorage { 
+    public:
+        typedef T LookupKey; 
+        static constexpr uint32_t kImageKeySize = sizeof(T); 
+        static constexpr ImageKeyKind kImageKeyKind = KeyKindOf<T>(); 
+        static LookupKey View(const T& key) { return key; }
+        void Assign(const vector<T>& keys, const vector<uint32_t>& order); 
+        LookupKey operator[] (const uint32_t index) const { return keys_[index]; }
+        size_t Size() const { return keys_.size(); }
+        void Write(ImageWriter& writer) const; 
+        bool Read(ImageReader& reader) { return reader.ReadArray(keys_); }
+        void Localize() { keys_.Localize(); }
+        size_t Bytes() const { return keys_.Bytes(); }
+    private:
+        FlatArray<T> keys_; 
+}; 
+
+// Strings are packed into one contiguous blob; offsets_[i] .. offsets_[i + 1] delimits key i.
+template <>
+class KeyStorage<std::string> { 
+    public:
+        typedef std::string_view LookupKey; 
+        static constexpr uint32_t kImageKeySize = 0; 
+        static constexpr ImageKeyKind kImageKeyKind = ImageKeyKind::kString; 
+        static LookupKey View(const std::string& key) { return key; }
+        void Assign(const vector<std::string>& keys, const vector<uint32_t>& order); 
+        // Clamped to the blob, since offsets of a loaded image aren't checked.
+        LookupKey operator[] (const uint32_t index) const { 
+            const uint64_t begin = std::min<uint64_t>(offsets_[index], blob_.size()); 
+            const uint64_t end = std::min<uint64_t>(offsets_[index + 1], blob_.size()); 
+            return LookupKey(blob_.data() + begin, (end > begin) ? end - begin : 0); 
+        }
+        size_t Size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+        void Write(ImageWriter& writer) const; 
+        bool Read(ImageReader& reader); 
+        void Localize() { blob_.Localize(); offsets_.Localize(); }
+        size_t Bytes() const { return blob_.Bytes() + offsets_.Bytes(); }
+    private:
+        FlatArray<char> blob_; 
+        FlatArray<uint64_t> offsets_; 
+}; 
+
+// Keys (given by their indices) grouped by hash code: bucket i holds
+// members[starts[i]] .. members[starts[i + 1] - 1].
+struct Buckets { 
+    vector<uint32_t> starts; 
+    vector<uint32_t> members; 
+    size_t Count() const { return starts.size() - 1; }
+    uint32_t Size(const size_t index) const { return starts[index + 1] - starts[index]; }
+}; 
+
+// What the last FixedSet build went through; sets loaded from an image have none.
+struct BuildStatistics { 
+    // Rounds of the IsSquaredLengthsSumLinear loop.
+    uint32_t first_level_attempts = 0; 
+    uint64_t sum_of_squares = 0; 
+    // load_histogram[k] is the number of first-level buckets with k keys.
+    vector<uint64_t> load_histogram; 
+    // attempts_histogram[k] is the number of buckets which needed k rounds of the
+    // CheckNoCollisions loop (empty buckets need none).
+    vector<uint64_t> attempts_histogram; 
+}; 
+
+// Second level of FixedSet: a collision-free function onto its own range of the shared slot
+// array. Empty buckets map every key to slot 0, which is never occupied.
+template <class HashFunctionClass>
 class InternalHashStructure { 
     private:
         HashFunctionClass function_; 
-        vector<T> table_; 
-        vector<bool> occupied_entries_; 
-        void MakeCorrectFieldsFromTable(const vector<vector<T>>& table); 
+        uint64_t offset_; 
     public:
-        InternalHashStructure() {}
-        template <class RandomGenerator>
-        void Initialize(const vector<T>& keys, 
+        InternalHashStructure() : offset_(0) {}
+        // Returns the number of functions drawn, 0 for an empty bucket.
+        template <class KeyAt, class RandomGenerator>
+        uint32_t Initialize(const uint32_t* members, const uint32_t count, const KeyAt& key_at,
+                        const uint32_t offset, vector<uint32_t>& slots,
+                        RandomGenerator& random_numbers_generator); 
+        uint64_t Slot(const uint64_t residue) const { return offset_ + function_(residue); }
+        // Whether every slot the function can give lies in a table of slot_count slots.
+        bool FitsIn(const size_t slot_count) const { 
+            return function_.size() > 0 && function_.size() <= slot_count &&
+                   offset_ <= slot_count - function_.size(); 
+        }
+}; 
+
+// Xor filter (Graf, Lemire) over the keys of a FixedSet: three reads from one byte array of
+// about 1.23 bytes per key reject all but roughly 1 / 256 of the keys outside the set, and
+// never reject a key of the set.
+template <class HashFunctionClass>
+class XorFilter { 
+    public:
+        template <class ResidueAt, class RandomGenerator>
+        void Initialize(const size_t count, const ResidueAt& residue_at,
                         RandomGenerator& random_numbers_generator); 
-        bool operator()(const T key) const; 
+        bool MayContain(const uint64_t residue) const; 
+        bool Empty() const { return fingerprints_.empty(); }
+        void Localize() { fingerprints_.Localize(); }
+        size_t Bytes() const { return fingerprints_.Bytes(); }
+        void Write(ImageWriter& writer) const; 
+        bool Read(ImageReader& reader); 
+        // Whether MayContain stays within the fingerprints, for a filter read from an image.
+        bool IsConsistent() const { 
+            return fingerprints_.size() % 3 == 0 && (fingerprints_.empty() || function_.size() > 0); 
+        }
+    private:
+        static uint64_t Mix(uint64_t hash); 
+        static uint8_t Fingerprint(const uint64_t hash) { return hash ^ (hash >> 32); }
+        void Positions(const uint64_t hash, uint64_t positions[3]) const; 
+        HashFunctionClass function_; 
+        uint64_t segment_length_ = 0; 
+        FlatArray<uint8_t> fingerprints_; 
 }; 
 
 template <class T, class HashFunctionClass>
 class FixedSet { 
-    public: 
+    public:
+        typedef typename KeyStorage<T>::LookupKey LookupKey; 
         FixedSet(); 
-        void Initialize(const vector<T>& keys); 
-        bool Contains(const T key) const; 
-    private: 
+        // A fixed seed makes the built tables, and so the saved image, reproducible.
+        explicit FixedSet(const uint32_t seed) : random_numbers_generator_(seed) {}
+        // With build_prefilter an XorFilter in front of the tables answers most misses
+        // without touching them.
+        void Initialize(const vector<T>& keys, const bool build_prefilter = false); 
+        // Writes the hash coefficients and the flat tables as one binary image.
+        bool Save(const std::string& path) const; 
+        // Maps a saved image read-only and looks keys up in place, so many processes can share
+        // one copy of the tables. On failure (missing file, foreign header, wrong checksum,
+        // tables of the wrong shape) returns false and leaves the set untouched. Only the
+        // checksum reads the whole image; lookups bound-check every table access instead, so
+        // without verify_checksum a corrupted image loads in constant time and may give wrong
+        // answers, though it never makes a lookup read outside the image.
+        bool Load(const std::string& path, const bool verify_checksum = true); 
+        // Copies the tables of a loaded image into memory allocated by the calling thread,
+        // which first-touch NUMA placement puts on that thread's node.
+        void Localize(); 
+        bool Contains(const LookupKey key) const; 
+        // Dense index in 0 .. Size() - 1 of key, or kEmptySlot if key is absent.
+        uint32_t Find(const LookupKey key) const; 
+        // Minimal perfect hash: the same index as Find for keys of the set, without reading
+        // the stored key back; for other keys either kEmptySlot or an arbitrary index.
+        uint32_t Index(const LookupKey key) const; 
+        size_t Size() const { return keys_.Size(); }
+        // Bytes of the tables, the stored keys and the prefilter.
+        size_t MemoryBytes() const; 
+        const BuildStatistics& Statistics() const { return statistics_; }
+        // A first-level function is redrawn until the squared bucket sizes sum to less than
+        // kLinearCoefficient * Size().
+        static constexpr uint32_t kLinearCoefficient = 4; 
+    private:
+        template <class K, class V, class H> friend class FixedMap; 
+        vector<uint32_t> Build(const vector<T>& keys); 
+        void BuildPrefilter(); 
+        uint64_t Residue(const LookupKey key) const { return KeyHasher<LookupKey>()(key, point_); }
+        uint32_t IndexOf(const uint64_t residue) const; 
+        uint64_t point_ = 0; 
         HashFunctionClass first_level_function_; 
-        vector<InternalHashStructure<T, HashFunctionClass>> extern_table_; 
+        FlatArray<InternalHashStructure<HashFunctionClass>> extern_table_; 
+        FlatArray<uint32_t> slots_; 
+        KeyStorage<T> keys_; 
+        XorFilter<HashFunctionClass> prefilter_; 
+        std::shared_ptr<MappedFile> image_; 
         std::mt19937 random_numbers_generator_; 
-        static bool IsSquaredLengthsSumLinear(const vector<vector<T>>& big_table); 
-        static constexpr uint32_t kLinearCoefficient = 4; 
+        BuildStatistics statistics_; 
+        static bool IsSquaredLengthsSumLinear(const Buckets& big_table); 
+        static constexpr char kImageMagic[8] = {'F', 'I', 'X', 'E', 'D', 'S', 'E', 'T'}; 
+        static constexpr uint32_t kImageVersion = 4; 
+        // Whether the loaded tables have the shape lookups rely on; IndexOf checks the
+        // second-level entries and slots it reads as it goes.
+        static bool IsConsistent(const HashFunctionClass& function,
+                                 const FlatArray<InternalHashStructure<HashFunctionClass>>& extern_table,
+                                 const FlatArray<uint32_t>& slots,
+                                 const XorFilter<HashFunctionClass>& prefilter); 
+}; 
+
+// Static key -> value map on top of FixedSet: values_ and fingerprints_ are parallel to the
+// set's dense indices, so a lookup is one perfect-hash probe plus one array read.
+template <class K, class V, class HashFunctionClass>
+class FixedMap { 
+    public:
+        typedef typename FixedSet<K, HashFunctionClass>::LookupKey LookupKey; 
+        // Of several equal keys the value of the first one is kept. build_prefilter puts an
+        // XorFilter in front of Find, as for FixedSet::Initialize.
+        void Initialize(const vector<K>& keys, const vector<V>& values,
+                        const bool build_prefilter = false); 
+        // Compares the stored key; nullptr for absent keys.
+        const V* Find(const LookupKey key) const; 
+        // Compares a 16-bit fingerprint instead of the key, so an absent key is reported
+        // present with probability about 1 / kFingerprintRange.
+        const V* FindByFingerprint(const LookupKey key) const; 
+        // Minimal perfect mode: dense indices 0 .. Size() - 1, see FixedSet::Index.
+        uint32_t Index(const LookupKey key) const { return set_.Index(key); }
+        const V& Value(const uint32_t index) const { return values_[index]; }
+        size_t Size() const { return values_.size(); }
+    private:
+        FixedSet<K, HashFunctionClass> set_; 
+        HashFunctionClass fingerprint_function_; 
+        vector<uint16_t> fingerprints_; 
+        vector<V> values_; 
+        static constexpr uint64_t kFingerprintRange = static_cast<uint64_t>(1) << 16; 
+}; 
+
+// Epoch-based reclamation: readers pin the current epoch while they dereference shared
+// objects, and a retired object is deleted only once every reader pinned before its
+// retirement has left.
+class EpochDomain { 
+    public:
+        class Guard { 
+            public:
+                explicit Guard(EpochDomain* domain) : domain_(domain), slot_(domain->Enter()) {}
+                ~Guard() { domain_->Exit(slot_); }
+                Guard(const Guard&) = delete; 
+                Guard& operator= (const Guard&) = delete; 
+            private:
+                EpochDomain* domain_; 
+                uint32_t slot_; 
+        }; 
+        EpochDomain() : epoch_(1) {}
+        // Runs the deleters still pending; no reader may be pinned any more.
+        ~EpochDomain(); 
+        EpochDomain(const EpochDomain&) = delete; 
+        EpochDomain& operator= (const EpochDomain&) = delete; 
+        Guard Pin() { return Guard(this); }
+        // deleter runs once no reader can still hold what was unlinked before this call.
+        void Retire(std::function<void()> deleter); 
+        void Collect(); 
+    private:
+        uint32_t Enter(); 
+        void Exit(const uint32_t slot) { slots_[slot].epoch.store(0, std::memory_order_release); }
+        // 0 marks a free slot; otherwise the epoch its reader pinned.
+        struct alignas(64) ReaderSlot { 
+            std::atomic<uint64_t> epoch{0}; 
+        }; 
+        static constexpr uint32_t kMaxReaders = 256; 
+        ReaderSlot slots_[kMaxReaders]; 
+        std::atomic<uint64_t> epoch_; 
+        std::mutex retired_mutex_; 
+        vector<std::pair<uint64_t, std::function<void()>>> retired_; 
+}; 
+
+// Dynamic perfect hashing (Dietzfelbinger et al.): the two levels of FixedSet, but a bucket
+// whose second-level table overflows or collides is rebuilt alone, and the whole table only
+// when the number of keys leaves [threshold_ / 4, threshold_] or the second-level tables
+// outgrow kMaxSpace * threshold_. Lookups stay two probes, updates are amortized O(1).
+// Writers are serialized and replace the buckets they change by new copies, so readers
+// never wait: they pin an epoch and see either the old or the new bucket.
+template <class T, class HashFunctionClass>
+class DynamicFixedSet { 
+    public:
+        typedef typename KeyStorage<T>::LookupKey LookupKey; 
+        DynamicFixedSet(); 
+        ~DynamicFixedSet(); 
+        DynamicFixedSet(const DynamicFixedSet&) = delete; 
+        DynamicFixedSet& operator= (const DynamicFixedSet&) = delete; 
+        // Both return whether the set has changed.
+        bool Insert(const T& key); 
+        bool Erase(const LookupKey key); 
+        bool Contains(const LookupKey key) const; 
+        // Lookup under a guard from Pin(), for readers checking many keys at once.
+        bool Contains(const LookupKey key, const EpochDomain::Guard& guard) const; 
+        EpochDomain::Guard Pin() const { return epochs_.Pin(); }
+        size_t Size() const { return size_.load(); }
+    private:
+        struct Bucket { 
+            HashFunctionClass function; 
+            uint32_t capacity; 
+            vector<T> keys; 
+            vector<uint32_t> table; 
+            bool Contains(const LookupKey key, const uint64_t residue) const { 
+                uint32_t index = table[function(residue)]; 
+                return (index != kEmptySlot) && (keys[index] == key); 
+            }
+        }; 
+        // Buckets reduce keys with the point of the directory they belong to.
+        struct Directory { 
+            uint64_t point; 
+            HashFunctionClass function; 
+            vector<std::atomic<const Bucket*>> buckets; 
+            ~Directory(); 
+        }; 
+        static uint64_t TableSize(const uint32_t capacity) { 
+            return static_cast<uint64_t>(capacity) * capacity; 
+        }
+        // nullptr if two of the keys have equal residues, which only a new point can separate.
+        Bucket* MakeBucket(vector<T>&& keys, const uint32_t capacity, const uint64_t point); 
+        void Replace(Directory* directory, const size_t index, const Bucket* bucket); 
+        vector<T> AllKeys() const; 
+        void RehashAll(vector<T>&& keys); 
+        std::atomic<Directory*> directory_; 
+        mutable EpochDomain epochs_; 
+        std::mutex writer_mutex_; 
+        std::mt19937 random_numbers_generator_; 
+        std::atomic<size_t> size_; 
+        size_t threshold_; 
+        uint64_t total_table_size_; 
+        static constexpr size_t kMinThreshold = 4; 
+        static constexpr uint64_t kRebuildSpace = 6; 
+        static constexpr uint64_t kMaxSpace = 12; 
+}; 
+
+// NUMA nodes and their CPUs as listed in /sys/devices/system/node; without that information
+// the machine is one node holding every CPU.
+class NumaTopology { 
+    public:
+        NumaTopology(); 
+        size_t NodeCount() const { return node_cpus_.size(); }
+        // Index (not id) of the node the calling thread runs on.
+        size_t CurrentNode() const; 
+        // Runs function on a thread bound to the CPUs of node, so that the memory it touches
+        // first is allocated there.
+        void RunOnNode(const size_t node, const std::function<void()>& function) const; 
+        // Runs function on a thread whose allocations are interleaved page by page over
+        // all nodes.
+        void RunInterleaved(const std::function<void()>& function) const; 
+    private:
+        static vector<int> ReadList(const std::string& path); 
+        vector<int> node_ids_; 
+        vector<vector<int>> node_cpus_; 
+        vector<size_t> cpu_nodes_; 
+}; 
+
+// Publishes one FixedSet to many reader threads. Publish copies the set onto every NUMA
+// node (or once, interleaved over the nodes) and swaps the copies in atomically; readers use
+// the copy of their own node without ever waiting for a swap, and the replaced copies are
+// freed once the readers which could still see them are gone.
+template <class T, class HashFunctionClass>
+class SharedFixedSet { 
+    public:
+        typedef typename FixedSet<T, HashFunctionClass>::LookupKey LookupKey; 
+        enum class Placement { kReplicate, kInterleave }; 
+        explicit SharedFixedSet(const Placement placement = Placement::kReplicate) :
+                generation_(nullptr), placement_(placement) {}
+        ~SharedFixedSet() { delete generation_.load(); }
+        SharedFixedSet(const SharedFixedSet&) = delete; 
+        SharedFixedSet& operator= (const SharedFixedSet&) = delete; 
+        void Publish(const FixedSet<T, HashFunctionClass>& set); 
+        bool Contains(const LookupKey key) const; 
+        bool Contains(const LookupKey key, const EpochDomain::Guard& guard) const { 
+            return Local(guard).Contains(key); 
+        }
+        EpochDomain::Guard Pin() const { return epochs_.Pin(); }
+        // The copy nearest to the calling thread, valid while guard lives. Something must
+        // have been published.
+        const FixedSet<T, HashFunctionClass>& Local(const EpochDomain::Guard& guard) const; 
+    private:
+        typedef vector<std::unique_ptr<FixedSet<T, HashFunctionClass>>> Generation; 
+        std::atomic<Generation*> generation_; 
+        mutable EpochDomain epochs_; 
+        std::mutex publisher_mutex_; 
+        Placement placement_; 
+        NumaTopology topology_; 
 }; 
 
-        
-vector<int> ReadKeys(std::istream& input_stream); 
-vector<int> ReadRequests(std::istream& input_stream); 
-vector<bool> MakeAnswers(const FixedSet<int, HashFunction>& set, 
-                         const vector<int>& requests);
+
+template <class T> 
+vector<T> ReadKeys(std::istream& input_stream); 
+template <class T> 
+vector<T> ReadRequests(std::istream& input_stream); 
+template <class T, class HashFunctionClass>
+vector<bool> MakeAnswers(const FixedSet<T, HashFunctionClass>& set,
+                         const vector<T>& requests); 
 void PrintAnswers(const vector<bool>& answers, std::ostream& ouput_stream); 
-template <class T, class HashFunctionClass> 
-vector<vector<T>> PutInBuckets(const vector<T>& keys, const HashFunctionClass function);  
 template <class T> 
-bool CheckNoCollisions(const vector<vector<T>>& table); 
+vector<T> ReadKeys(FastInput& input); 
+template <class T, class HashFunctionClass>
+void AnswerRequests(const FixedSet<T, HashFunctionClass>& set, FastInput& input,
+                    FastOutput& output); 
+template <class KeyAt, class HashFunctionClass>
+Buckets PutInBuckets(const vector<uint32_t>& indices, const KeyAt& key_at,
+                     const HashFunctionClass& function); 
+template <class KeyAt>
+void RemoveDuplicates(Buckets& table, const KeyAt& key_at); 
+template <class ResidueAt>
+bool HasDistinctResidues(const Buckets& table, const ResidueAt& residue_at); 
+void RunScalingBenchmark(const size_t set_size, std::ostream& output_stream); 
+bool RunCheck(std::ostream& output_stream); 
+template <class T, class HashFunctionClass, class MakeKey>
+bool CheckFixedSet(const std::string& name, const MakeKey& make_key, std::ostream& output_stream); 
+template <class HashFunctionClass>
+bool CheckFixedMap(std::ostream& output_stream); 
+template <class T, class HashFunctionClass, class MakeKey>
+bool CheckAgainstModel(const std::string& name, const MakeKey& make_key, std::ostream& output_stream); 
+template <class HashFunctionClass>
+bool CheckConcurrentChurn(std::ostream& output_stream); 
+template <class HashFunctionClass>
+void RunBenchmark(const size_t max_set_size, std::ostream& output_stream); 
+template <class HashFunctionClass>
+void RunQualityReport(std::ostream& output_stream); 
+template <class T, class HashFunctionClass>
+double MeasureLookups(const FixedSet<T, HashFunctionClass>& set, const vector<T>& requests); 
+template <class T, class HashFunctionClass>
+void ReportKeySetQuality(const std::string& name, const vector<T>& keys, const uint32_t builds,
+                         std::ostream& output_stream); 
+void AddToHistogram(vector<uint64_t>& histogram, const size_t value, const uint64_t count = 1); 
+template <class KeyAt, class HashFunctionClass>
+bool CheckNoCollisions(const uint32_t* members, const uint32_t count, const KeyAt& key_at,
+                       const HashFunctionClass& function, uint32_t* table); 
 
-int main() { 
-    std::istream& input_stream = std::cin; 
-    std::ostream& output_stream = std::cout; 
-    auto keys = ReadKeys(input_stream); 
+// With no arguments reads the keys and then the requests from stdin.
+// --save <image> [seed]: reads the keys, builds the set and saves its image;
+// --load <image> [--no-verify]: maps a saved image and reads only the requests; --no-verify
+// skips the checksum, which is the only part of loading that reads the whole image;
+// --scaling [keys]: measures lookup throughput of a SharedFixedSet for 1 .. 64 threads;
+// --check: compares FixedSet and FixedMap with std::set and std::map, and DynamicFixedSet with
+// std::set, alone and under concurrent readers (see RunCheck);
+// --benchmark [max keys]: build time, memory and lookup time from 1000 keys up, then the
+// hash quality report (see RunBenchmark and RunQualityReport).
+int main(int argc, char* argv[]) { 
+    FastInput input(STDIN_FILENO); 
+    FastOutput output(STDOUT_FILENO); 
+    const std::string mode = (argc > 1) ? argv[1] : ""; 
+    if (mode == "--scaling") { 
+        RunScalingBenchmark((argc > 2) ? std::stoul(argv[2]) : 1 << 20, std::cout); 
+        return 0; 
+    }
+    if (mode == "--check") { 
+        return RunCheck(std::cout) ? 0 : 1; 
+    }
+    if (mode == "--benchmark") { 
+        RunBenchmark<HashFunction>((argc > 2) ? std::stoul(argv[2]) : 100000000, std::cout); 
+        RunQualityReport<HashFunction>(std::cout); 
+        return 0; 
+    }
+    if ((mode == "--load" || mode == "--save") && argc < 3) { 
+        std::cerr << "Usage: " << argv[0] << " " << mode << " <image>\n"; 
+        return 1; 
+    }
     FixedSet<int, HashFunction> set; 
-    set.Initialize(keys); 
-    const vector<int> requests = ReadRequests(input_stream); 
-    vector<bool> answers = MakeAnswers(set, requests); 
-    PrintAnswers(answers, output_stream); 
+    if (mode == "--load") { 
+        const bool verify_checksum = !(argc > 3 && std::string(argv[3]) == "--no-verify"); 
+        if (!set.Load(argv[2], verify_checksum)) { 
+            std::cerr << "Can't load image " << argv[2] << "\n"; 
+            return 1; 
+        }
+    } else { 
+        auto keys = ReadKeys<int>(input); 
+        if (mode == "--save" && argc > 3) { 
+            set = FixedSet<int, HashFunction>(std::stoul(argv[3])); 
+        }
+        set.Initialize(keys); 
+        if (mode == "--save") { 
+            return set.Save(argv[2]) ? 0 : 1; 
+        }
+    }
+    AnswerRequests(set, input, output); 
     return 0; 
 }
 
-uint64_t HashFunction::operator() (const int key) const { 
-    int residue = key % prime_modulo_; 
-    uint64_t positive_residue = (residue < 0) ? (residue + prime_modulo_) : residue; 
-    return ((first_coeff_ * positive_residue + second_coeff_) % prime_modulo_) % table_size_; 
+uint64_t AddModMersenne(const uint64_t first, const uint64_t second) { 
+    uint64_t sum = first + second; 
+    return (sum >= HashFunction::kBigPrime) ? (sum - HashFunction::kBigPrime) : sum; 
 }
 
-HashFunction::HashFunction(const uint64_t first, const uint64_t second, 
-                           const uint64_t size, const uint64_t modulo) : 
-        first_coeff_(first), second_coeff_(second), table_size_(size), 
-        prime_modulo_(modulo) {
+uint64_t MultiplyModMersenne(const uint64_t first, const uint64_t second) { 
+    unsigned __int128 product = static_cast<unsigned __int128>(first) * second; 
+    uint64_t low = static_cast<uint64_t>(product) & HashFunction::kBigPrime; 
+    uint64_t high = static_cast<uint64_t>(product >> 61); 
+    return AddModMersenne(low, high); 
 }
 
-template <class RandomGenerator>
-HashFunction HashFunction::MakeRandom(const uint64_t size,
-                                      RandomGenerator& random_numbers_generator,
-                                      const uint64_t prime_modulo) { 
-    std::uniform_int_distribution<size_t> first_distribution(1, prime_modulo - 1); 
-    uint64_t first = first_distribution(random_numbers_generator); 
-    std::uniform_int_distribution<size_t> second_distribution(0, prime_modulo - 1); 
-    uint64_t second = second_distribution(random_numbers_generator); 
-    return HashFunction(first, second, size, prime_modulo); 
+uint64_t HashBytes(const char* data, const size_t length, const uint64_t point) { 
+    // The length goes first, so keys which differ only by trailing zero bytes don't collide.
+    uint64_t value = length % HashFunction::kBigPrime; 
+    size_t position = 0; 
+    for (; position + sizeof(uint32_t) <= length; position += sizeof(uint32_t)) { 
+        uint32_t word; 
+        std::memcpy(&word, data + position, sizeof(word)); 
+        value = AddModMersenne(MultiplyModMersenne(value, point), word); 
+    }
+    if (position < length) { 
+        uint32_t word = 0; 
+        std::memcpy(&word, data + position, length - position); 
+        value = AddModMersenne(MultiplyModMersenne(value, point), word); 
+    }
+    return value; 
 }
-    
-                                                        
-const uint64_t HashFunction::size() const { 
-    return table_size_; 
+
+// FNV-1a over 64-bit words; detects truncated or corrupted images, not tampering.
+uint64_t ImageChecksum(const char* data, const size_t length) { 
+    constexpr uint64_t kPrime = 0x100000001b3; 
+    uint64_t checksum = 0xcbf29ce484222325; 
+    size_t position = 0; 
+    for (; position + sizeof(uint64_t) <= length; position += sizeof(uint64_t)) { 
+        uint64_t word; 
+        std::memcpy(&word, data + position, sizeof(word)); 
+        checksum = (checksum ^ word) * kPrime; 
+    }
+    for (; position < length; ++position) { 
+        checksum = (checksum ^ static_cast<uint8_t>(data[position])) * kPrime; 
+    }
+    return checksum; 
 }
 
-template <class T, class HashFunctionClass> template <class RandomGenerator>
-void InternalHashStructure<T, HashFunctionClass>::Initialize(const vector<T>& keys,
-                                         RandomGenerator& random_numbers_generator) {
-    if (keys.empty()) { 
-        return; 
+template <class T> 
+FlatArray<T>& FlatArray<T>::operator= (const FlatArray& other) { 
+    if (this == &other) { 
+        return *this; 
     }
-    uint64_t size = keys.size() * keys.size(); 
-    vector<vector<T>> table; 
-    HashFunctionClass function;
-    do { 
-        function = HashFunctionClass::template MakeRandom<RandomGenerator>(size, 
-                                                                random_numbers_generator);
-        table = PutInBuckets<T, HashFunctionClass>(keys, function); 
-    } while (!CheckNoCollisions<T>(table)); 
-    function_ = function; 
-    MakeCorrectFieldsFromTable(table); 
+    owned_ = other.owned_; 
+    data_ = (other.data_ == other.owned_.data()) ? owned_.data() : other.data_; 
+    size_ = other.size_; 
+    return *this; 
 }
 
-template <class T, class HashFunctionClass> 
-void InternalHashStructure<T, HashFunctionClass>::MakeCorrectFieldsFromTable(
-                                                            const vector<vector<T>>& table) { 
-    table_.assign(table.size(), T());
-    occupied_entries_ = vector<bool>(table.size()); 
-    for (int i = 0; i < table.size(); ++i) { 
-        if (!table[i].empty()) { 
-            occupied_entries_[i] = true; 
-            table_[i] = table[i][0]; 
-        }
+template <class T> 
+void FlatArray<T>::Assign(vector<T>&& elements) { 
+    owned_ = std::move(elements); 
+    data_ = owned_.data(); 
+    size_ = owned_.size(); 
+}
+
+template <class T> 
+void FlatArray<T>::Refer(const T* data, const size_t size) { 
+    owned_.clear(); 
+    owned_.shrink_to_fit(); 
+    data_ = data; 
+    size_ = size; 
+}
+
+template <class T> 
+void FlatArray<T>::Localize() { 
+    if (owned_.empty() && size_ > 0) { 
+        Assign(vector<T>(data_, data_ + size_)); 
     }
 }
 
-template <class T, class HashFunctionClass>
-bool InternalHashStructure<T, HashFunctionClass>::operator() (const T key) const { 
-    if (table_.empty()) { 
+void ImageWriter::WriteSection(const void* data, const uint64_t length) { 
+    const char* length_bytes = reinterpret_cast<const char*>(&length); 
+    buffer_.insert(buffer_.end(), length_bytes, length_bytes + sizeof(length)); 
+    const char* bytes = static_cast<const char*>(data); 
+    buffer_.insert(buffer_.end(), bytes, bytes + length); 
+    buffer_.resize((buffer_.size() + 7) / 8 * 8, 0); 
+}
+
+const char* ImageReader::ReadSection(uint64_t& length) { 
+    if (size_ - position_ < sizeof(length)) { 
+        return nullptr; 
+    }
+    std::memcpy(&length, data_ + position_, sizeof(length)); 
+    position_ += sizeof(length); 
+    if (size_ - position_ < length) { 
+        return nullptr; 
+    }
+    const char* section = data_ + position_; 
+    position_ = std::min<size_t>(size_, position_ + (length + 7) / 8 * 8); 
+    return section; 
+}
+
+template <class E>
+bool ImageReader::ReadArray(FlatArray<E>& array) { 
+    uint64_t length; 
+    const char* section = ReadSection(length); 
+    if (section == nullptr || length % sizeof(E) != 0) { 
         return false; 
     }
-    uint64_t int_hash_code = function_(key); 
-    return occupied_entries_[int_hash_code] ? (table_[int_hash_code] == key) : false;
+    array.Refer(reinterpret_cast<const E*>(section), length / sizeof(E)); 
+    return true; 
 }
 
-template <class T, class HashFunctionClass>
-FixedSet<T, HashFunctionClass>::FixedSet() { 
-    std::random_device random; 
-    random_numbers_generator_ = std::mt19937 (random()); 
+template <class E>
+bool ImageReader::ReadValue(E& value) { 
+    uint64_t length; 
+    const char* section = ReadSection(length); 
+    if (section == nullptr || length != sizeof(E)) { 
+        return false; 
+    }
+    std::memcpy(&value, section, sizeof(E)); 
+    return true; 
 }
 
-template <class T, class HashFunctionClass>
-void FixedSet<T, HashFunctionClass>::Initialize (const vector<T>& keys) { 
-    const uint32_t set_size = keys.size(); 
-    vector<std::vector<T>> big_table; 
-    HashFunctionClass function; 
-    do { 
-        function = HashFunctionClass::MakeRandom(set_size, random_numbers_generator_); 
-        big_table = PutInBuckets(keys, function); 
-    } while (!IsSquaredLengthsSumLinear(big_table));
-    first_level_function_ = function; 
-    extern_table_.assign(set_size, InternalHashStructure<T, HashFunctionClass>());
-    for (int index = 0; index < set_size; ++index) { 
-            extern_table_[index].Initialize(big_table[index], random_numbers_generator_); 
+MappedFile::~MappedFile() { 
+    if (data_ != nullptr) { 
+        munmap(const_cast<char*>(data_), size_); 
     }
 }
 
-template <class T, class HashFunctionClass>
-bool FixedSet<T, HashFunctionClass>::Contains(const T key) const { 
-    size_t ext_hash_code = first_level_function_(key); 
-    return extern_table_[ext_hash_code](key); 
+bool MappedFile::Open(const std::string& path) { 
+    int descriptor = open(path.c_str(), O_RDONLY); 
+    if (descriptor < 0) { 
+        return false; 
+    }
+    bool mapped = Map(descriptor); 
+    close(descriptor); 
+    return mapped; 
 }
 
-template <class T, class HashFunctionClass>
-bool FixedSet<T, HashFunctionClass>::IsSquaredLengthsSumLinear(
-                                                  const vector<std::vector<T>>& big_table) { 
-    auto size = big_table.size(); 
-    auto up_border = kLinearCoefficient * size; 
-    uint64_t sum_of_squares = 0; 
-    for (auto& entry : big_table) { 
-            sum_of_squares += entry.size() * entry.size(); 
+bool MappedFile::Map(const int descriptor) { 
+    struct stat file_stat; 
+    if (fstat(descriptor, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        file_stat.st_size == 0) { 
+        return false; 
     }
-    return (sum_of_squares < up_border); 
+    void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, descriptor, 0); 
+    if (data == MAP_FAILED) { 
+        return false; 
+    }
+    data_ = static_cast<const char*>(data); 
+    size_ = file_stat.st_size; 
+    return true; 
 }
 
-template <class T, class HashFunctionClass>
-vector<vector<T>> PutInBuckets(const vector<T>& keys, const HashFunctionClass function) { 
-    vector<vector<T>> big_table(function.size()); 
-    for (const auto key : keys) { 
-        uint64_t hash_code = function(key); 
-        big_table[hash_code].push_back(key); 
+FastInput::FastInput(const int descriptor) : descriptor_(descriptor), position_(nullptr),
+                                             end_(nullptr), exhausted_(false) { 
+    off_t offset = lseek(descriptor, 0, SEEK_CUR); 
+    if (offset >= 0 && mapping_.Map(descriptor) && static_cast<size_t>(offset) <= mapping_.Size()) { 
+        madvise(const_cast<char*>(mapping_.Data()), mapping_.Size(), MADV_SEQUENTIAL); 
+        position_ = mapping_.Data() + offset; 
+        end_ = mapping_.Data() + mapping_.Size(); 
+        exhausted_ = true; 
     }
-    return big_table; 
 }
 
-template <class T> 
-bool CheckNoCollisions(const vector<vector<T>>& table) { 
-    for (const auto& intern_table : table) { 
-        if (intern_table.size() > 1) { 
+// Keeps the unread tail and appends the next block; returns whether any input is left.
+bool FastInput::Refill() { 
+    if (exhausted_) { 
+        return position_ < end_; 
+    }
+    size_t tail = end_ - position_; 
+    vector<char> block(std::max(kBlockSize, 2 * tail)); 
+    if (tail > 0) { 
+        std::memcpy(block.data(), position_, tail); 
+    }
+    buffer_.swap(block); 
+    size_t size = tail; 
+    while (size < buffer_.size()) { 
+        ssize_t bytes_read = read(descriptor_, buffer_.data() + size, buffer_.size() - size); 
+        if (bytes_read <= 0) { 
+            exhausted_ = true; 
+            break; 
+        }
+        size += bytes_read; 
+    }
+    position_ = buffer_.data(); 
+    end_ = buffer_.data() + size; 
+    return position_ < end_; 
+}
+
+template <class Integer>
+bool FastInput::ReadInteger(Integer& value) { 
+    while (true) { 
+        if (position_ == end_ && !Refill()) { 
+            return false; 
+        }
+        if (!std::isspace(static_cast<unsigned char>(*position_))) { 
+            break; 
+        }
+        ++position_; 
+    }
+    if (end_ - position_ < kMaxTokenLength) { 
+        Refill(); 
+    }
+    bool negative = (*position_ == '-'); 
+    if (negative || *position_ == '+') { 
+        ++position_; 
+    }
+    if (position_ == end_ || static_cast<unsigned>(*position_ - '0') >= 10) { 
+        SkipToken(); 
+        return false; 
+    }
+    // The largest magnitude Integer can take with this sign.
+    const uint64_t limit = !negative ? static_cast<uint64_t>(std::numeric_limits<Integer>::max()) :
+                           std::is_signed<Integer>::value ?
+                           static_cast<uint64_t>(std::numeric_limits<Integer>::max()) + 1 : 0; 
+    uint64_t magnitude = 0; 
+    while (position_ < end_ && static_cast<unsigned>(*position_ - '0') < 10) { 
+        const uint64_t digit = *position_ - '0'; 
+        if (magnitude > limit / 10 || digit > limit - magnitude * 10) { 
+            SkipToken(); 
             return false; 
         }
+        magnitude = magnitude * 10 + digit; 
+        ++position_; 
     }
+    value = static_cast<Integer>(negative ? (0 - magnitude) : magnitude); 
     return true; 
 }
 
-vector<int> ReadKeys(std::istream& input_stream) { 
-    size_t num_of_keys; 
-    input_stream >> num_of_keys; 
-    vector<int> keys(num_of_keys); 
-    for (auto& key : keys) { 
-        input_stream >> key; 
+void FastInput::SkipToken() { 
+    while ((position_ < end_ || Refill()) && !std::isspace(static_cast<unsigned char>(*position_))) { 
+        ++position_; 
     }
-    return keys; 
 }
 
-vector<int> ReadRequests(std::istream& input_stream) { 
-    return ReadKeys(input_stream);
+void FastOutput::Write(const char* data, const size_t length) { 
+    buffer_.insert(buffer_.end(), data, data + length); 
+    if (buffer_.size() >= kBlockSize) { 
+        Flush(); 
+    }
 }
 
-vector<bool> MakeAnswers(const FixedSet<int, HashFunction>& set, 
-                         const vector<int>& requests) { 
-    vector<bool> answers; 
-    answers.reserve(requests.size()); 
-    for (const auto request : requests) { 
-        answers.push_back(set.Contains(request)); 
+void FastOutput::Flush() { 
+    size_t written = 0; 
+    while (written < buffer_.size()) { 
+        ssize_t bytes_written = write(descriptor_, buffer_.data() + written,
+                                      buffer_.size() - written); 
+        if (bytes_written <= 0) { 
+            break; 
+        }
+        written += bytes_written; 
     }
-    return answers; 
+    buffer_.clear(); 
 }
 
-void PrintAnswers(const vector<bool>& answers, std::ostream& output_stream) { 
-    for (auto answer : answers) { 
-        if (answer) {
-            output_stream << "Yes\n"; 
-        } else { 
-            output_stream << "No\n"; 
-        }
+template <class E>
+void ChunkQueue<E>::Push(E&& element) { 
+    std::unique_lock<std::mutex> lock(mutex_); 
+    not_full_.wait(lock, [this] { return elements_.size() < capacity_; }); 
+    elements_.push_back(std::move(element)); 
+    not_empty_.notify_one(); 
+}
+
+template <class E>
+void ChunkQueue<E>::Close() { 
+    std::lock_guard<std::mutex> lock(mutex_); 
+    closed_ = true; 
+    not_empty_.notify_all(); 
+}
+
+template <class E>
+bool ChunkQueue<E>::Pop(E& element) { 
+    std::unique_lock<std::mutex> lock(mutex_); 
+    not_empty_.wait(lock, [this] { return !elements_.empty() || closed_; }); 
+    if (elements_.empty()) { 
+        return false; 
+    }
+    element = std::move(elements_.front()); 
+    elements_.pop_front(); 
+    not_full_.notify_one(); 
+    return true; 
+}
+
+template <class Key>
+uint64_t KeyHasher<Key, typename std::enable_if<std::is_integral<Key>::value>::type>::operator() (
+                                                    const Key key, const uint64_t point) const { 
+    uint64_t bits = static_cast<uint64_t>(key); 
+    if (sizeof(Key) <= sizeof(uint32_t)) { 
+        return static_cast<uint32_t>(bits); 
+    }
+    return AddModMersenne(MultiplyModMersenne(bits >> 32, point), bits & 0xffffffffu); 
+}
+
+uint64_t HashFunction::operator() (const uint64_t residue) const { 
+    return AddModMersenne(MultiplyModMersenne(first_coeff_, residue), second_coeff_) % table_size_; 
+}
+
+HashFunction::HashFunction(const uint64_t first, const uint64_t second, const uint64_t size) :
+        first_coeff_(first), second_coeff_(second), table_size_(size) { 
+}
+
+template <class RandomGenerator>
+HashFunction HashFunction::MakeRandom(const uint64_t size,
+                                      RandomGenerator& random_numbers_generator) { 
+    std::uniform_int_distribution<uint64_t> first_distribution(1, kBigPrime - 1); 
+    uint64_t first = first_distribution(random_numbers_generator); 
+    std::uniform_int_distribution<uint64_t> second_distribution(0, kBigPrime - 1); 
+    uint64_t second = second_distribution(random_numbers_generator); 
+    return HashFunction(first, second, size); 
+}
+
+template <class RandomGenerator>
+uint64_t HashFunction::MakeRandomPoint(RandomGenerator& random_numbers_generator) { 
+    std::uniform_int_distribution<uint64_t> distribution(0, kBigPrime - 1); 
+    return distribution(random_numbers_generator); 
+}
+
+
+const uint64_t HashFunction::size() const { 
+    return table_size_; 
+}
+
+template <class T> 
+void KeyStorage<T>::Assign(const vector<T>& keys, const vector<uint32_t>& order) { 
+    vector<T> stored_keys; 
+    stored_keys.reserve(order.size()); 
+    for (const auto index : order) { 
+        stored_keys.push_back(keys[index]); 
+    }
+    keys_.Assign(std::move(stored_keys)); 
+}
+
+template <class T> 
+void KeyStorage<T>::Write(ImageWriter& writer) const { 
+    static_assert(std::is_trivially_copyable<T>::value, "keys must be trivially copyable"); 
+    writer.WriteArray(keys_); 
+}
+
+void KeyStorage<std::string>::Assign(const vector<std::string>& keys,
+                                     const vector<uint32_t>& order) { 
+    uint64_t total_length = 0; 
+    for (const auto index : order) { 
+        total_length += keys[index].size(); 
+    }
+    vector<char> blob; 
+    blob.reserve(total_length); 
+    vector<uint64_t> offsets(1, 0); 
+    offsets.reserve(order.size() + 1); 
+    for (const auto index : order) { 
+        blob.insert(blob.end(), keys[index].begin(), keys[index].end()); 
+        offsets.push_back(blob.size()); 
+    }
+    blob_.Assign(std::move(blob)); 
+    offsets_.Assign(std::move(offsets)); 
+}
+
+void KeyStorage<std::string>::Write(ImageWriter& writer) const { 
+    writer.WriteArray(blob_); 
+    writer.WriteArray(offsets_); 
+}
+
+bool KeyStorage<std::string>::Read(ImageReader& reader) { 
+    return reader.ReadArray(blob_) && reader.ReadArray(offsets_) && !offsets_.empty(); 
+}
+
+template <class HashFunctionClass> template <class KeyAt, class RandomGenerator>
+uint32_t InternalHashStructure<HashFunctionClass>::Initialize(const uint32_t* members,
+                                         const uint32_t count, const KeyAt& key_at,
+                                         const uint32_t offset, vector<uint32_t>& slots,
+                                         RandomGenerator& random_numbers_generator) {
+    offset_ = offset; 
+    if (count == 0) { 
+        function_ = HashFunctionClass::MakeRandom(1, random_numbers_generator); 
+        return 0; 
     }
+    uint64_t size = static_cast<uint64_t>(count) * count; 
+    uint32_t attempts = 0; 
+    do { 
+        function_ = HashFunctionClass::MakeRandom(size, random_numbers_generator); 
+        ++attempts; 
+    } while (!CheckNoCollisions(members, count, key_at, function_, slots.data() + offset)); 
+    return attempts; 
 }
 
+// Peels the 3-partite hypergraph of key positions: a position hit by exactly one key can be
+// fixed last for that key. If some keys can't be peeled a new function is drawn.
+template <class HashFunctionClass> template <class ResidueAt, class RandomGenerator>
+void XorFilter<HashFunctionClass>::Initialize(const size_t count, const ResidueAt& residue_at,
+                                              RandomGenerator& random_numbers_generator) { 
+    segment_length_ = (32 + 123 * count / 100) / 3 + 1; 
+    const uint64_t capacity = 3 * segment_length_; 
+    vector<uint64_t> hashes(count); 
+    vector<uint32_t> hits(capacity); 
+    vector<uint64_t> xored_hashes(capacity); 
+    vector<uint64_t> peeled_positions; 
+    vector<uint64_t> peeled_hashes; 
+    uint64_t positions[3]; 
+    do { 
+        function_ = HashFunctionClass::MakeRandom(std::numeric_limits<uint64_t>::max(),
+                                                  random_numbers_generator); 
+        std::fill(hits.begin(), hits.end(), 0); 
+        std::fill(xored_hashes.begin(), xored_hashes.end(), 0); 
+        for (size_t index = 0; index < count; ++index) { 
+            hashes[index] = Mix(function_(residue_at(index))); 
+            Positions(hashes[index], positions); 
+            for (const auto position : positions) { 
+                ++hits[position]; 
+                xored_hashes[position] ^= hashes[index]; 
+            }
+        }
+        vector<uint64_t> queue; 
+        for (uint64_t position = 0; position < capacity; ++position) { 
+            if (hits[position] == 1) { 
+                queue.push_back(position); 
+            }
+        }
+        peeled_positions.clear(); 
+        peeled_hashes.clear(); 
+        while (!queue.empty()) { 
+            uint64_t position = queue.back(); 
+            queue.pop_back(); 
+            if (hits[position] != 1) { 
+                continue; 
+            }
+            uint64_t hash = xored_hashes[position]; 
+            peeled_positions.push_back(position); 
+            peeled_hashes.push_back(hash); 
+            Positions(hash, positions); 
+            for (const auto other : positions) { 
+                --hits[other]; 
+                xored_hashes[other] ^= hash; 
+                if (hits[other] == 1) { 
+                    queue.push_back(other); 
+                }
+            }
+        }
+    } while (peeled_positions.size() != count); 
+    vector<uint8_t> table(capacity, 0); 
+    for (size_t index = count; index-- > 0;) { 
+        Positions(peeled_hashes[index], positions); 
+        table[peeled_positions[index]] = Fingerprint(peeled_hashes[index]) ^ table[positions[0]] ^
+                                         table[positions[1]] ^ table[positions[2]]; 
+    }
+    fingerprints_.Assign(std::move(table)); 
+}
+
+template <class HashFunctionClass>
+bool XorFilter<HashFunctionClass>::MayContain(const uint64_t residue) const { 
+    uint64_t hash = Mix(function_(residue)); 
+    uint64_t positions[3]; 
+    Positions(hash, positions); 
+    return Fingerprint(hash) == (fingerprints_[positions[0]] ^ fingerprints_[positions[1]] ^
+                                 fingerprints_[positions[2]]); 
+}
+
+// The murmur3 finalizer: spreads a universal hash over all 64 bits.
+template <class HashFunctionClass>
+uint64_t XorFilter<HashFunctionClass>::Mix(uint64_t hash) { 
+    hash ^= hash >> 33; 
+    hash *= 0xff51afd7ed558ccd; 
+    hash ^= hash >> 33; 
+    hash *= 0xc4ceb9fe1a85ec53; 
+    hash ^= hash >> 33; 
+    return hash; 
+}
+
+// One position in each third of the table, by multiply-shift range reduction.
+template <class HashFunctionClass>
+void XorFilter<HashFunctionClass>::Positions(const uint64_t hash, uint64_t positions[3]) const { 
+    const uint64_t rotated[3] = {hash, (hash << 21) | (hash >> 43), (hash << 42) | (hash >> 22)}; 
+    for (int segment = 0; segment < 3; ++segment) { 
+        uint64_t bits = static_cast<uint32_t>(rotated[segment]); 
+        positions[segment] = segment * segment_length_ + ((bits * segment_length_) >> 32); 
+    }
+}
+
+template <class HashFunctionClass>
+void XorFilter<HashFunctionClass>::Write(ImageWriter& writer) const { 
+    writer.WriteValue(function_); 
+    writer.WriteArray(fingerprints_); 
+}
+
+template <class HashFunctionClass>
+bool XorFilter<HashFunctionClass>::Read(ImageReader& reader) { 
+    if (!reader.ReadValue(function_) || !reader.ReadArray(fingerprints_) || !IsConsistent()) { 
+        return false; 
+    }
+    segment_length_ = fingerprints_.size() / 3; 
+    return true; 
+}
+
+template <class T, class HashFunctionClass>
+FixedSet<T, HashFunctionClass>::FixedSet() { 
+    std::random_device random; 
+    random_numbers_generator_ = std::mt19937 (random()); 
+}
+
+template <class T, class HashFunctionClass>
+void FixedSet<T, HashFunctionClass>::Initialize (const vector<T>& keys,
+                                                 const bool build_prefilter) { 
+    Build(keys); 
+    if (build_prefilter) { 
+        BuildPrefilter(); 
+    }
+}
+
+template <class T, class HashFunctionClass>
+void FixedSet<T, HashFunctionClass>::BuildPrefilter() { 
+    auto residue_at = [this](const uint32_t index) { return Residue(keys_[index]); }; 
+    prefilter_.Initialize(keys_.Size(), residue_at, random_numbers_generator_); 
+}
+
+// Returns the position in keys of every stored key, in dense index order.
+template <class T, class HashFunctionClass>
+vector<uint32_t> FixedSet<T, HashFunctionClass>::Build(const vector<T>& keys) { 
+    auto key_at = [&keys](const uint32_t index) { return KeyStorage<T>::View(keys[index]); }; 
+    const uint32_t set_size = std::max<size_t>(keys.size(), 1); 
+    vector<uint64_t> residues(keys.size()); 
+    auto residue_at = [&residues](const uint32_t index) { return residues[index]; }; 
+    Buckets big_table; 
+    HashFunctionClass function;
+    statistics_ = BuildStatistics(); 
+    do { 
+        point_ = HashFunctionClass::MakeRandomPoint(random_numbers_generator_); 
+        for (size_t index = 0; index < keys.size(); ++index) { 
+            residues[index] = Residue(key_at(index)); 
+        }
+        vector<uint32_t> indices(keys.size()); 
+        std::iota(indices.begin(), indices.end(), 0); 
+        do { 
+            ++statistics_.first_level_attempts; 
+            function = HashFunctionClass::MakeRandom(set_size, random_numbers_generator_); 
+            big_table = PutInBuckets(indices, residue_at, function); 
+            RemoveDuplicates(big_table, key_at); 
+            indices = big_table.members; 
+        } while (!IsSquaredLengthsSumLinear(big_table)); 
+    } while (!HasDistinctResidues(big_table, residue_at)); 
+    first_level_function_ = function; 
+    vector<InternalHashStructure<HashFunctionClass>> extern_table(set_size); 
+    uint64_t slots_size = 1; 
+    for (size_t index = 0; index < set_size; ++index) { 
+        slots_size += static_cast<uint64_t>(big_table.Size(index)) * big_table.Size(index); 
+        AddToHistogram(statistics_.load_histogram, big_table.Size(index)); 
+    }
+    statistics_.sum_of_squares = slots_size - 1; 
+    vector<uint32_t> slots(slots_size, kEmptySlot); 
+    uint32_t offset = 1; 
+    for (size_t index = 0; index < set_size; ++index) { 
+        const uint32_t count = big_table.Size(index); 
+        uint32_t attempts = extern_table[index].Initialize(
+                                big_table.members.data() + big_table.starts[index], count,
+                                residue_at, (count == 0) ? 0 : offset, slots,
+                                random_numbers_generator_); 
+        AddToHistogram(statistics_.attempts_histogram, attempts); 
+        offset += count * count; 
+    }
+    // Slots hold key indices; renumber them densely so that keys_ is stored in slot order.
+    vector<uint32_t> order; 
+    order.reserve(big_table.members.size()); 
+    for (auto& slot : slots) { 
+        if (slot != kEmptySlot) { 
+            order.push_back(slot); 
+            slot = order.size() - 1; 
+        }
+    }
+    extern_table_.Assign(std::move(extern_table)); 
+    slots_.Assign(std::move(slots)); 
+    keys_.Assign(keys, order); 
+    prefilter_ = XorFilter<HashFunctionClass>(); 
+    image_.reset(); 
+    return order; 
+}
+
+template <class T, class HashFunctionClass>
+bool FixedSet<T, HashFunctionClass>::Save(const std::string& path) const { 
+    static_assert(std::is_trivially_copyable<HashFunctionClass>::value,
+                  "hash functions are stored in images byte by byte"); 
+    ImageWriter writer; 
+    writer.WriteValue(point_); 
+    writer.WriteValue(first_level_function_); 
+    writer.WriteArray(extern_table_); 
+    writer.WriteArray(slots_); 
+    keys_.Write(writer); 
+    prefilter_.Write(writer); 
+    const vector<char>& payload = writer.Buffer(); 
+    ImageHeader header = {}; 
+    std::memcpy(header.magic, kImageMagic, sizeof(header.magic)); 
+    header.version = kImageVersion; 
+    header.key_size = KeyStorage<T>::kImageKeySize; 
+    header.key_kind = KeyStorage<T>::kImageKeyKind; 
+    header.function_size = sizeof(HashFunctionClass); 
+    header.payload_size = payload.size(); 
+    header.checksum = ImageChecksum(payload.data(), payload.size()); 
+    std::ofstream output_stream(path, std::ios::binary | std::ios::trunc); 
+    output_stream.write(reinterpret_cast<const char*>(&header), sizeof(header)); 
+    output_stream.write(payload.data(), payload.size()); 
+    return static_cast<bool>(output_stream.flush()); 
+}
+
+template <class T, class HashFunctionClass>
+bool FixedSet<T, HashFunctionClass>::Load(const std::string& path, const bool verify_checksum) { 
+    auto image = std::make_shared<MappedFile>(); 
+    if (!image->Open(path) || image->Size() < sizeof(ImageHeader)) { 
+        return false; 
+    }
+    ImageHeader header; 
+    std::memcpy(&header, image->Data(), sizeof(header)); 
+    const char* payload = image->Data() + sizeof(header); 
+    if (std::memcmp(header.magic, kImageMagic, sizeof(header.magic)) != 0 ||
+        header.version != kImageVersion ||
+        header.key_size != KeyStorage<T>::kImageKeySize ||
+        header.key_kind != KeyStorage<T>::kImageKeyKind ||
+        header.function_size != sizeof(HashFunctionClass) ||
+        header.payload_size != image->Size() - sizeof(header)) { 
+        return false; 
+    }
+    if (verify_checksum && ImageChecksum(payload, header.payload_size) != header.checksum) { 
+        return false; 
+    }
+    ImageReader reader(payload, header.payload_size); 
+    uint64_t point; 
+    HashFunctionClass function;
+    FlatArray<InternalHashStructure<HashFunctionClass>> extern_table; 
+    FlatArray<uint32_t> slots; 
+    KeyStorage<T> keys; 
+    XorFilter<HashFunctionClass> prefilter; 
+    if (!reader.ReadValue(point) || !reader.ReadValue(function) || !reader.ReadArray(extern_table) ||
+        !reader.ReadArray(slots) || !keys.Read(reader) || !prefilter.Read(reader) ||
+        !IsConsistent(function, extern_table, slots, prefilter)) { 
+        return false; 
+    }
+    point_ = point; 
+    first_level_function_ = function; 
+    extern_table_ = std::move(extern_table); 
+    slots_ = std::move(slots); 
+    keys_ = std::move(keys); 
+    prefilter_ = std::move(prefilter); 
+    image_ = std::move(image); 
+    statistics_ = BuildStatistics(); 
+    return true; 
+}
+
+// Constant time, so loading stays independent of the number of keys.
+template <class T, class HashFunctionClass>
+bool FixedSet<T, HashFunctionClass>::IsConsistent(const HashFunctionClass& function,
+                                 const FlatArray<InternalHashStructure<HashFunctionClass>>& extern_table,
+                                 const FlatArray<uint32_t>& slots,
+                                 const XorFilter<HashFunctionClass>& prefilter) { 
+    return function.size() > 0 && extern_table.size() == function.size() && !slots.empty() &&
+           prefilter.IsConsistent(); 
+}
+
+template <class T, class HashFunctionClass>
+void FixedSet<T, HashFunctionClass>::Localize() { 
+    extern_table_.Localize(); 
+    slots_.Localize(); 
+    keys_.Localize(); 
+    prefilter_.Localize(); 
+    image_.reset(); 
+}
+
+template <class T, class HashFunctionClass>
+bool FixedSet<T, HashFunctionClass>::Contains(const LookupKey key) const { 
+    return Find(key) != kEmptySlot; 
+}
+
+template <class T, class HashFunctionClass>
+uint32_t FixedSet<T, HashFunctionClass>::Find(const LookupKey key) const { 
+    const uint64_t residue = Residue(key); 
+    if (!prefilter_.Empty() && !prefilter_.MayContain(residue)) { 
+        return kEmptySlot; 
+    }
+    uint32_t index = IndexOf(residue); 
+    return (index != kEmptySlot && keys_[index] == key) ? index : kEmptySlot; 
+}
+
+template <class T, class HashFunctionClass>
+uint32_t FixedSet<T, HashFunctionClass>::Index(const LookupKey key) const { 
+    return IndexOf(Residue(key)); 
+}
+
+template <class T, class HashFunctionClass>
+uint32_t FixedSet<T, HashFunctionClass>::IndexOf(const uint64_t residue) const { 
+    const auto& structure = extern_table_[first_level_function_(residue)]; 
+    // Built tables always pass these checks; a loaded image only had IsConsistent applied.
+    if (!structure.FitsIn(slots_.size())) { 
+        return kEmptySlot; 
+    }
+    uint32_t index = slots_[structure.Slot(residue)]; 
+    return (index < keys_.Size()) ? index : kEmptySlot; 
+}
+
+template <class T, class HashFunctionClass>
+size_t FixedSet<T, HashFunctionClass>::MemoryBytes() const { 
+    return extern_table_.Bytes() + slots_.Bytes() + keys_.Bytes() + prefilter_.Bytes(); 
+}
+
+template <class T, class HashFunctionClass>
+bool FixedSet<T, HashFunctionClass>::IsSquaredLengthsSumLinear(const Buckets& big_table) { 
+    auto size = big_table.Count(); 
+    auto up_border = kLinearCoefficient * size; 
+    uint64_t sum_of_squares = 0; 
+    for (size_t index = 0; index < size; ++index) { 
+            sum_of_squares += static_cast<uint64_t>(big_table.Size(index)) * big_table.Size(index); 
+    }
+    return (sum_of_squares < up_border); 
+}
+
+template <class K, class V, class HashFunctionClass>
+void FixedMap<K, V, HashFunctionClass>::Initialize(const vector<K>& keys, 
+                                                   const vector<V>& values,
+                                                   const bool build_prefilter) { 
+    assert(keys.size() == values.size()); 
+    const vector<uint32_t> order = set_.Build(keys); 
+    if (build_prefilter) { 
+        set_.BuildPrefilter(); 
+    }
+    fingerprint_function_ = HashFunctionClass::MakeRandom(kFingerprintRange, 
+                                                          set_.random_numbers_generator_); 
+    fingerprints_.clear(); 
+    fingerprints_.reserve(order.size()); 
+    values_.clear(); 
+    values_.reserve(order.size()); 
+    for (const auto index : order) { 
+        const uint64_t residue = set_.Residue(KeyStorage<K>::View(keys[index])); 
+        fingerprints_.push_back(fingerprint_function_(residue)); 
+        values_.push_back(values[index]); 
+    }
+}
+
+template <class K, class V, class HashFunctionClass>
+const V* FixedMap<K, V, HashFunctionClass>::Find(const LookupKey key) const { 
+    uint32_t index = set_.Find(key); 
+    return (index == kEmptySlot) ? nullptr : &values_[index]; 
+}
+
+template <class K, class V, class HashFunctionClass>
+const V* FixedMap<K, V, HashFunctionClass>::FindByFingerprint(const LookupKey key) const { 
+    const uint64_t residue = set_.Residue(key); 
+    uint32_t index = set_.IndexOf(residue); 
+    if (index == kEmptySlot || fingerprints_[index] != fingerprint_function_(residue)) { 
+        return nullptr; 
+    }
+    return &values_[index]; 
+}
+
+EpochDomain::~EpochDomain() { 
+    for (auto& retired : retired_) { 
+        retired.second(); 
+    }
+}
+
+// Claims a free slot, starting from one fixed per thread so that threads rarely meet.
+uint32_t EpochDomain::Enter() { 
+    static thread_local const uint32_t start =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) % kMaxReaders; 
+    for (uint32_t attempt = 0; ; ++attempt) { 
+        auto& slot = slots_[(start + attempt) % kMaxReaders]; 
+        uint64_t free_epoch = 0; 
+        if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+            slot.epoch.compare_exchange_strong(free_epoch, epoch_.load())) { 
+            return (start + attempt) % kMaxReaders; 
+        }
+        if (attempt % kMaxReaders == kMaxReaders - 1) { 
+            std::this_thread::yield(); 
+        }
+    }
+}
+
+void EpochDomain::Retire(std::function<void()> deleter) { 
+    std::lock_guard<std::mutex> lock(retired_mutex_); 
+    retired_.emplace_back(epoch_.fetch_add(1), std::move(deleter)); 
+}
+
+void EpochDomain::Collect() { 
+    uint64_t oldest_pinned = std::numeric_limits<uint64_t>::max(); 
+    for (const auto& slot : slots_) { 
+        uint64_t epoch = slot.epoch.load(); 
+        if (epoch != 0) { 
+            oldest_pinned = std::min(oldest_pinned, epoch); 
+        }
+    }
+    vector<std::function<void()>> ready; 
+    { 
+        std::lock_guard<std::mutex> lock(retired_mutex_); 
+        auto pending = std::stable_partition(retired_.begin(), retired_.end(),
+                [oldest_pinned](const std::pair<uint64_t, std::function<void()>>& retired) { 
+                    return retired.first >= oldest_pinned; 
+                }); 
+        for (auto iterator = pending; iterator != retired_.end(); ++iterator) { 
+            ready.push_back(std::move(iterator->second)); 
+        }
+        retired_.erase(pending, retired_.end()); 
+    }
+    for (auto& deleter : ready) { 
+        deleter(); 
+    }
+}
+
+template <class T, class HashFunctionClass>
+DynamicFixedSet<T, HashFunctionClass>::DynamicFixedSet() : directory_(nullptr), size_(0),
+                                                           threshold_(0), total_table_size_(0) { 
+    std::random_device random; 
+    random_numbers_generator_ = std::mt19937 (random()); 
+    RehashAll(vector<T>()); 
+}
+
+template <class T, class HashFunctionClass>
+DynamicFixedSet<T, HashFunctionClass>::~DynamicFixedSet() { 
+    delete directory_.load(); 
+}
+
+template <class T, class HashFunctionClass>
+DynamicFixedSet<T, HashFunctionClass>::Directory::~Directory() { 
+    for (auto& bucket : buckets) { 
+        delete bucket.load(); 
+    }
+}
+
+template <class T, class HashFunctionClass>
+bool DynamicFixedSet<T, HashFunctionClass>::Contains(const LookupKey key) const { 
+    auto guard = epochs_.Pin(); 
+    return Contains(key, guard); 
+}
+
+template <class T, class HashFunctionClass>
+bool DynamicFixedSet<T, HashFunctionClass>::Contains(const LookupKey key,
+                                                     const EpochDomain::Guard&) const { 
+    const Directory* directory = directory_.load(); 
+    const uint64_t residue = KeyHasher<LookupKey>()(key, directory->point); 
+    const Bucket* bucket = directory->buckets[directory->function(residue)].load(); 
+    return (bucket != nullptr) && bucket->Contains(key, residue); 
+}
+
+template <class T, class HashFunctionClass>
+bool DynamicFixedSet<T, HashFunctionClass>::Insert(const T& key) { 
+    std::lock_guard<std::mutex> lock(writer_mutex_); 
+    const LookupKey view = KeyStorage<T>::View(key); 
+    Directory* directory = directory_.load(); 
+    const uint64_t residue = KeyHasher<LookupKey>()(view, directory->point); 
+    const size_t index = directory->function(residue); 
+    const Bucket* bucket = directory->buckets[index].load(); 
+    if (bucket != nullptr && bucket->Contains(view, residue)) { 
+        return false; 
+    }
+    size_.store(size_.load() + 1); 
+    if (size_.load() > threshold_) { 
+        vector<T> keys = AllKeys(); 
+        keys.push_back(key); 
+        RehashAll(std::move(keys)); 
+        return true; 
+    }
+    const uint32_t capacity = (bucket == nullptr) ? 0 : bucket->capacity; 
+    vector<T> keys = (bucket == nullptr) ? vector<T>() : bucket->keys; 
+    keys.push_back(key); 
+    Bucket* replacement; 
+    if (keys.size() <= capacity && bucket->table[bucket->function(residue)] == kEmptySlot) { 
+        replacement = new Bucket(*bucket); 
+        replacement->keys = std::move(keys); 
+        replacement->table[replacement->function(residue)] = replacement->keys.size() - 1; 
+    } else { 
+        const uint32_t new_capacity = (keys.size() <= capacity) ? capacity :
+                                                                  2 * std::max<uint32_t>(capacity, 1); 
+        total_table_size_ += TableSize(new_capacity) - TableSize(capacity); 
+        if (total_table_size_ > kMaxSpace * threshold_) { 
+            keys = AllKeys(); 
+            keys.push_back(key); 
+            RehashAll(std::move(keys)); 
+            return true; 
+        }
+        replacement = MakeBucket(std::move(keys), new_capacity, directory->point); 
+        if (replacement == nullptr) { 
+            keys = AllKeys(); 
+            keys.push_back(key); 
+            RehashAll(std::move(keys)); 
+            return true; 
+        }
+    }
+    Replace(directory, index, replacement); 
+    return true; 
+}
+
+template <class T, class HashFunctionClass>
+bool DynamicFixedSet<T, HashFunctionClass>::Erase(const LookupKey key) { 
+    std::lock_guard<std::mutex> lock(writer_mutex_); 
+    Directory* directory = directory_.load(); 
+    const uint64_t residue = KeyHasher<LookupKey>()(key, directory->point); 
+    const size_t index = directory->function(residue); 
+    const Bucket* bucket = directory->buckets[index].load(); 
+    if (bucket == nullptr || !bucket->Contains(key, residue)) { 
+        return false; 
+    }
+    size_.store(size_.load() - 1); 
+    if (threshold_ > kMinThreshold && size_.load() < threshold_ / 4) { 
+        vector<T> keys = AllKeys(); 
+        keys.erase(std::find(keys.begin(), keys.end(), key)); 
+        RehashAll(std::move(keys)); 
+        return true; 
+    }
+    Bucket* replacement = nullptr; 
+    if (bucket->keys.size() == 1) { 
+        total_table_size_ -= TableSize(bucket->capacity); 
+    } else { 
+        // The function stays injective on fewer keys: move the last key into the hole.
+        replacement = new Bucket(*bucket); 
+        const uint64_t hash_code = replacement->function(residue); 
+        const uint32_t position = replacement->table[hash_code]; 
+        replacement->table[hash_code] = kEmptySlot; 
+        if (position + 1 != replacement->keys.size()) { 
+            replacement->keys[position] = std::move(replacement->keys.back()); 
+            const auto moved_key = KeyStorage<T>::View(replacement->keys[position]); 
+            const uint64_t moved_residue = KeyHasher<LookupKey>()(moved_key, directory->point); 
+            replacement->table[replacement->function(moved_residue)] = position; 
+        }
+        replacement->keys.pop_back(); 
+    }
+    Replace(directory, index, replacement); 
+    return true; 
+}
+
+template <class T, class HashFunctionClass>
+typename DynamicFixedSet<T, HashFunctionClass>::Bucket*
+DynamicFixedSet<T, HashFunctionClass>::MakeBucket(vector<T>&& keys, const uint32_t capacity,
+                                                  const uint64_t point) { 
+    vector<uint64_t> residues(keys.size()); 
+    for (size_t index = 0; index < keys.size(); ++index) { 
+        residues[index] = KeyHasher<LookupKey>()(KeyStorage<T>::View(keys[index]), point); 
+    }
+    vector<uint64_t> sorted_residues = residues; 
+    std::sort(sorted_residues.begin(), sorted_residues.end()); 
+    if (std::adjacent_find(sorted_residues.begin(),
+                           sorted_residues.end()) != sorted_residues.end()) { 
+        return nullptr; 
+    }
+    Bucket* bucket = new Bucket(); 
+    bucket->capacity = capacity; 
+    bucket->keys = std::move(keys); 
+    vector<uint32_t> members(bucket->keys.size()); 
+    std::iota(members.begin(), members.end(), 0); 
+    auto residue_at = [&residues](const uint32_t index) { return residues[index]; }; 
+    do { 
+        bucket->function = HashFunctionClass::MakeRandom(TableSize(capacity),
+                                                         random_numbers_generator_); 
+        bucket->table.assign(TableSize(capacity), kEmptySlot); 
+    } while (!CheckNoCollisions(members.data(), members.size(), residue_at, bucket->function,
+                                bucket->table.data())); 
+    return bucket; 
+}
+
+template <class T, class HashFunctionClass>
+void DynamicFixedSet<T, HashFunctionClass>::Replace(Directory* directory, const size_t index,
+                                                    const Bucket* bucket) { 
+    const Bucket* old_bucket = directory->buckets[index].exchange(bucket); 
+    if (old_bucket != nullptr) { 
+        epochs_.Retire([old_bucket] { delete old_bucket; }); 
+    }
+    epochs_.Collect(); 
+}
+
+template <class T, class HashFunctionClass>
+vector<T> DynamicFixedSet<T, HashFunctionClass>::AllKeys() const { 
+    vector<T> keys; 
+    for (const auto& slot : directory_.load()->buckets) { 
+        const Bucket* bucket = slot.load(); 
+        if (bucket != nullptr) { 
+            keys.insert(keys.end(), bucket->keys.begin(), bucket->keys.end()); 
+        }
+    }
+    return keys; 
+}
+
+// Buckets start at capacity 2 * (their size), so that they can double before rebuilding.
+template <class T, class HashFunctionClass>
+void DynamicFixedSet<T, HashFunctionClass>::RehashAll(vector<T>&& keys) { 
+    threshold_ = std::max(kMinThreshold, 2 * keys.size()); 
+    vector<uint64_t> residues(keys.size()); 
+    auto residue_at = [&residues](const uint32_t index) { return residues[index]; }; 
+    vector<uint32_t> indices(keys.size()); 
+    std::iota(indices.begin(), indices.end(), 0); 
+    uint64_t point; 
+    HashFunctionClass function;
+    Buckets big_table; 
+    uint64_t total_table_size; 
+    do { 
+        point = HashFunctionClass::MakeRandomPoint(random_numbers_generator_); 
+        for (size_t index = 0; index < keys.size(); ++index) { 
+            residues[index] = KeyHasher<LookupKey>()(KeyStorage<T>::View(keys[index]), point); 
+        }
+        do { 
+            function = HashFunctionClass::MakeRandom(threshold_, random_numbers_generator_); 
+            big_table = PutInBuckets(indices, residue_at, function); 
+            total_table_size = 0; 
+            for (size_t index = 0; index < big_table.Count(); ++index) { 
+                total_table_size += TableSize(2 * big_table.Size(index)); 
+            }
+        } while (total_table_size > kRebuildSpace * threshold_); 
+    } while (!HasDistinctResidues(big_table, residue_at)); 
+    Directory* directory = new Directory(); 
+    directory->point = point; 
+    directory->function = function; 
+    directory->buckets = vector<std::atomic<const Bucket*>>(threshold_); 
+    for (size_t index = 0; index < big_table.Count(); ++index) { 
+        if (big_table.Size(index) == 0) { 
+            continue; 
+        }
+        vector<T> bucket_keys; 
+        for (uint32_t member = big_table.starts[index]; member < big_table.starts[index + 1]; 
+             ++member) { 
+            bucket_keys.push_back(std::move(keys[big_table.members[member]])); 
+        }
+        directory->buckets[index].store(MakeBucket(std::move(bucket_keys),
+                                                   2 * big_table.Size(index), point)); 
+    }
+    total_table_size_ = total_table_size; 
+    size_.store(keys.size()); 
+    Directory* old_directory = directory_.exchange(directory); 
+    if (old_directory != nullptr) { 
+        epochs_.Retire([old_directory] { delete old_directory; }); 
+    }
+    epochs_.Collect(); 
+}
+
+NumaTopology::NumaTopology() { 
+    node_ids_ = ReadList("/sys/devices/system/node/online"); 
+    for (const auto node_id : node_ids_) { 
+        node_cpus_.push_back(ReadList("/sys/devices/system/node/node" +
+                                      std::to_string(node_id) + "/cpulist")); 
+    }
+    if (node_ids_.empty()) { 
+        node_ids_.assign(1, 0); 
+        node_cpus_.assign(1, vector<int>()); 
+        for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) { 
+            node_cpus_[0].push_back(cpu); 
+        }
+    }
+    for (size_t node = 0; node < node_cpus_.size(); ++node) { 
+        for (const auto cpu : node_cpus_[node]) { 
+            if (static_cast<size_t>(cpu) >= cpu_nodes_.size()) { 
+                cpu_nodes_.resize(cpu + 1, 0); 
+            }
+            cpu_nodes_[cpu] = node; 
+        }
+    }
+}
+
+// Parses lists such as "0-3,8,10-11"; a missing file gives an empty list.
+vector<int> NumaTopology::ReadList(const std::string& path) { 
+    std::ifstream input_stream(path); 
+    std::string range; 
+    vector<int> list; 
+    while (std::getline(input_stream, range, ',')) { 
+        int first = 0; 
+        int last = 0; 
+        char dash = 0; 
+        std::istringstream range_stream(range); 
+        if (!(range_stream >> first)) { 
+            continue; 
+        }
+        last = (range_stream >> dash >> last) ? last : first; 
+        for (int element = first; element <= last; ++element) { 
+            list.push_back(element); 
+        }
+    }
+    return list; 
+}
+
+// Threads seldom move between nodes, so the CPU is only asked for every kRecheckPeriod calls.
+size_t NumaTopology::CurrentNode() const { 
+    constexpr uint32_t kRecheckPeriod = 1 << 10; 
+    static thread_local uint32_t calls = 0; 
+    static thread_local size_t node = 0; 
+    if (calls++ % kRecheckPeriod == 0) { 
+        int cpu = sched_getcpu(); 
+        node = (cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes_.size()) ? cpu_nodes_[cpu] : 0; 
+    }
+    return node; 
+}
+
+void NumaTopology::RunOnNode(const size_t node, const std::function<void()>& function) const { 
+    std::thread worker([this, node, &function] { 
+        cpu_set_t cpus; 
+        CPU_ZERO(&cpus); 
+        for (const auto cpu : node_cpus_[node]) { 
+            CPU_SET(cpu, &cpus); 
+        }
+        if (!node_cpus_[node].empty()) { 
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); 
+        }
+        function(); 
+    }); 
+    worker.join(); 
+}
+
+void NumaTopology::RunInterleaved(const std::function<void()>& function) const { 
+    std::thread worker([this, &function] { 
+        unsigned long mask = 0; 
+        for (const auto node_id : node_ids_) { 
+            if (node_id < static_cast<int>(8 * sizeof(mask))) { 
+                mask |= 1ul << node_id; 
+            }
+        }
+        // The policy belongs to this thread only and ends with it.
+        syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, &mask, 8 * sizeof(mask)); 
+        function(); 
+    }); 
+    worker.join(); 
+}
+
+template <class T, class HashFunctionClass>
+void SharedFixedSet<T, HashFunctionClass>::Publish(const FixedSet<T, HashFunctionClass>& set) { 
+    std::lock_guard<std::mutex> lock(publisher_mutex_); 
+    Generation* generation = new Generation(); 
+    auto copy = [&set, generation] { 
+        generation->emplace_back(new FixedSet<T, HashFunctionClass>(set)); 
+        generation->back()->Localize(); 
+    }; 
+    if (placement_ == Placement::kInterleave || topology_.NodeCount() == 1) { 
+        topology_.RunInterleaved(copy); 
+    } else { 
+        for (size_t node = 0; node < topology_.NodeCount(); ++node) { 
+            topology_.RunOnNode(node, copy); 
+        }
+    }
+    Generation* old_generation = generation_.exchange(generation); 
+    if (old_generation != nullptr) { 
+        epochs_.Retire([old_generation] { delete old_generation; }); 
+    }
+    epochs_.Collect(); 
+}
+
+template <class T, class HashFunctionClass>
+bool SharedFixedSet<T, HashFunctionClass>::Contains(const LookupKey key) const { 
+    auto guard = epochs_.Pin(); 
+    return Contains(key, guard); 
+}
+
+template <class T, class HashFunctionClass>
+const FixedSet<T, HashFunctionClass>& SharedFixedSet<T, HashFunctionClass>::Local(
+                                                        const EpochDomain::Guard&) const { 
+    const Generation& generation = *generation_.load(); 
+    return (generation.size() == 1) ? *generation[0] : *generation[topology_.CurrentNode()]; 
+}
+
+// Lookups of random keys, about half of them present, by 1, 2, 4, .. 64 threads at once.
+void RunScalingBenchmark(const size_t set_size, std::ostream& output_stream) { 
+    constexpr size_t kLookupsPerThread = 1 << 22; 
+    constexpr size_t kBatchSize = 1 << 10; 
+    std::mt19937_64 random_numbers_generator(1); 
+    vector<uint64_t> keys(set_size); 
+    for (auto& key : keys) { 
+        key = random_numbers_generator() | 1; 
+    }
+    FixedSet<uint64_t, HashFunction> set(1); 
+    set.Initialize(keys); 
+    SharedFixedSet<uint64_t, HashFunction> shared_set; 
+    shared_set.Publish(set); 
+    output_stream << "threads\tlookups/s\tns/lookup per thread\n"; 
+    for (size_t threads = 1; threads <= 64; threads *= 2) { 
+        std::atomic<size_t> found(0); 
+        auto start = std::chrono::steady_clock::now(); 
+        vector<std::thread> readers; 
+        for (size_t reader = 0; reader < threads; ++reader) { 
+            readers.emplace_back([&shared_set, &keys, &found, reader] { 
+                std::mt19937_64 requests_generator(reader); 
+                size_t local_found = 0; 
+                for (size_t batch = 0; batch < kLookupsPerThread / kBatchSize; ++batch) { 
+                    auto guard = shared_set.Pin(); 
+                    for (size_t lookup = 0; lookup < kBatchSize; ++lookup) { 
+                        uint64_t random = requests_generator(); 
+                        uint64_t key = (random & 2) ? keys[(random >> 2) % keys.size()] : random & ~1ull; 
+                        local_found += shared_set.Contains(key, guard); 
+                    }
+                }
+                found += local_found; 
+            }); 
+        }
+        for (auto& reader : readers) { 
+            reader.join(); 
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); 
+        double lookups = static_cast<double>(threads) * kLookupsPerThread; 
+        output_stream << threads << "\t" << lookups / seconds << "\t"
+                      << 1e9 * seconds * threads / lookups << "\n"; 
+    }
+}
+
+// Returns whether all the checks passed; each reports its own result.
+bool RunCheck(std::ostream& output_stream) { 
+    bool passed = CheckFixedSet<int, HashFunction>("int keys",
+                      [](const uint64_t value) { return static_cast<int>(value); }, output_stream); 
+    passed &= CheckFixedSet<std::string, HashFunction>("string keys",
+                  [](const uint64_t value) { return "key" + std::to_string(value); }, output_stream); 
+    passed &= CheckFixedSet<ByteKey<12>, HashFunction>("12-byte keys", [](const uint64_t value) { 
+                  ByteKey<12> key{}; 
+                  std::memcpy(key.data() + 4, &value, sizeof(value)); 
+                  return key; 
+              }, output_stream); 
+    passed &= CheckFixedMap<HashFunction>(output_stream); 
+    passed &= CheckAgainstModel<uint64_t, HashFunction>("uint64_t keys",
+                      [](const uint64_t random) { return random % 20000; }, output_stream); 
+    passed &= CheckAgainstModel<std::string, HashFunction>("string keys",
+                  [](const uint64_t random) { return std::to_string(random % 20000); }, output_stream); 
+    passed &= CheckConcurrentChurn<HashFunction>(output_stream); 
+    return passed; 
+}
+
+// Builds a set with a prefilter from make_key(0 .. kKeys - 1) drawn with repetitions, then
+// compares it with std::set on make_key(0 .. 2 * kKeys - 1): first as built, then saved to a
+// temporary image and loaded back. Members reported absent, which include any the prefilter
+// wrongly rejects, are counted separately.
+template <class T, class HashFunctionClass, class MakeKey>
+bool CheckFixedSet(const std::string& name, const MakeKey& make_key, std::ostream& output_stream) { 
+    constexpr uint64_t kKeys = 20000; 
+    std::mt19937_64 random_numbers_generator(2); 
+    vector<T> keys; 
+    for (uint64_t index = 0; index < kKeys; ++index) { 
+        keys.push_back(make_key(random_numbers_generator() % kKeys)); 
+    }
+    std::set<T> model(keys.begin(), keys.end()); 
+    FixedSet<T, HashFunctionClass> set; 
+    set.Initialize(keys, true); 
+    size_t missing = 0; 
+    for (const auto& key : model) { 
+        missing += !set.Contains(KeyStorage<T>::View(key)); 
+    }
+    size_t mismatches = set.Size() != model.size(); 
+    auto compare = [&make_key, &model, &mismatches](const FixedSet<T, HashFunctionClass>& checked) { 
+        for (uint64_t value = 0; value < 2 * kKeys; ++value) { 
+            const T key = make_key(value); 
+            mismatches += checked.Contains(KeyStorage<T>::View(key)) != (model.count(key) == 1); 
+        }
+    }; 
+    compare(set); 
+    char path[] = "/tmp/fixed_set_check_XXXXXX"; 
+    const int descriptor = mkstemp(path); 
+    FixedSet<T, HashFunctionClass> loaded; 
+    const bool round_trip = descriptor >= 0 && set.Save(path) && loaded.Load(path); 
+    if (descriptor >= 0) { 
+        close(descriptor); 
+        unlink(path); 
+    }
+    if (round_trip) { 
+        compare(loaded); 
+    }
+    output_stream << "FixedSet, " << name << ": " << missing << " members missing, " << mismatches
+                  << " mismatches" << (round_trip ? "" : ", save/load failed") << "\n"; 
+    return round_trip && missing == 0 && mismatches == 0; 
+}
+
+// String keys with repetitions, each mapped to its position, against std::map::emplace (which
+// also keeps the first value). Index must number the keys 0 .. Size() - 1; absent keys may pass
+// FindByFingerprint only at about the 1 / 65536 rate of its fingerprints.
+template <class HashFunctionClass>
+bool CheckFixedMap(std::ostream& output_stream) { 
+    constexpr uint32_t kKeys = 20000; 
+    constexpr uint32_t kAbsentKeys = 200000; 
+    std::mt19937_64 random_numbers_generator(3); 
+    vector<std::string> keys; 
+    vector<uint32_t> values; 
+    std::map<std::string, uint32_t> model; 
+    for (uint32_t index = 0; index < kKeys; ++index) { 
+        keys.push_back("key" + std::to_string(random_numbers_generator() % kKeys)); 
+        values.push_back(index); 
+        model.emplace(keys.back(), index); 
+    }
+    FixedMap<std::string, uint32_t, HashFunctionClass> map; 
+    map.Initialize(keys, values, true); 
+    size_t mismatches = map.Size() != model.size(); 
+    vector<bool> numbered(map.Size(), false); 
+    for (const auto& entry : model) { 
+        const uint32_t* found = map.Find(entry.first); 
+        mismatches += (found == nullptr) || (*found != entry.second); 
+        found = map.FindByFingerprint(entry.first); 
+        mismatches += (found == nullptr) || (*found != entry.second); 
+        const uint32_t index = map.Index(entry.first); 
+        if (index >= map.Size() || numbered[index]) { 
+            ++mismatches; 
+        } else { 
+            numbered[index] = true; 
+            mismatches += map.Value(index) != entry.second; 
+        }
+    }
+    size_t false_positives = 0; 
+    for (uint32_t value = kKeys; value < kKeys + kAbsentKeys; ++value) { 
+        const std::string key = "key" + std::to_string(value); 
+        mismatches += map.Find(key) != nullptr; 
+        false_positives += map.FindByFingerprint(key) != nullptr; 
+    }
+    output_stream << "FixedMap, string keys: " << mismatches << " mismatches, " << false_positives
+                  << " fingerprint false positives in " << kAbsentKeys << " absent keys\n"; 
+    return mismatches == 0 && false_positives <= kAbsentKeys / 4096; 
+}
+
+// Random inserts, erases and lookups of a few thousand distinct keys, so buckets grow, get
+// rehashed and shrink again, then erasure of everything left.
+template <class T, class HashFunctionClass, class MakeKey>
+bool CheckAgainstModel(const std::string& name, const MakeKey& make_key, std::ostream& output_stream) { 
+    constexpr size_t kOperations = 200000; 
+    std::mt19937_64 random_numbers_generator(1); 
+    DynamicFixedSet<T, HashFunctionClass> set; 
+    std::set<T> model; 
+    size_t mismatches = 0; 
+    for (size_t operation = 0; operation < kOperations; ++operation) { 
+        const T key = make_key(random_numbers_generator()); 
+        switch (random_numbers_generator() % 3) { 
+            case 0:
+                mismatches += set.Insert(key) != model.insert(key).second; 
+                break; 
+            case 1:
+                mismatches += set.Erase(key) != (model.erase(key) == 1); 
+                break; 
+            default:
+                mismatches += set.Contains(key) != (model.count(key) == 1); 
+        }
+        mismatches += set.Size() != model.size(); 
+    }
+    for (const auto& key : model) { 
+        mismatches += !set.Erase(key); 
+    }
+    mismatches += set.Size() != 0; 
+    output_stream << "DynamicFixedSet, " << name << ": " << mismatches << " mismatches\n"; 
+    return mismatches == 0; 
+}
+
+// Readers look up keys which stay in the set while one writer inserts and erases others,
+// which makes it replace buckets and the directory under them; then the result is compared
+// with the writer's model. Run it under TSan and ASan to check the reclamation too.
+template <class HashFunctionClass>
+bool CheckConcurrentChurn(std::ostream& output_stream) { 
+    constexpr uint64_t kStableKeys = 1000; 
+    constexpr size_t kWrites = 200000; 
+    constexpr size_t kReaders = 4; 
+    DynamicFixedSet<uint64_t, HashFunctionClass> set; 
+    std::set<uint64_t> model; 
+    for (uint64_t key = 0; key < kStableKeys; ++key) { 
+        set.Insert(2 * key); 
+        model.insert(2 * key); 
+    }
+    std::atomic<bool> stop(false); 
+    std::atomic<size_t> lookups(0); 
+    std::atomic<size_t> mismatches(0); 
+    vector<std::thread> readers; 
+    for (size_t reader = 0; reader < kReaders; ++reader) { 
+        readers.emplace_back([&set, &stop, &lookups, &mismatches, reader] { 
+            std::mt19937_64 requests_generator(reader); 
+            while (!stop.load()) { 
+                auto guard = set.Pin(); 
+                for (size_t lookup = 0; lookup < 100; ++lookup) { 
+                    mismatches += !set.Contains(2 * (requests_generator() % kStableKeys), guard); 
+                }
+                lookups += 100; 
+            }
+        }); 
+    }
+    std::mt19937_64 random_numbers_generator(1); 
+    for (size_t write = 0; write < kWrites; ++write) { 
+        uint64_t key = 2 * (random_numbers_generator() % 50000) + 1; 
+        if (random_numbers_generator() % 2) { 
+            mismatches += set.Insert(key) != model.insert(key).second; 
+        } else { 
+            mismatches += set.Erase(key) != (model.erase(key) == 1); 
+        }
+    }
+    stop = true; 
+    for (auto& reader : readers) { 
+        reader.join(); 
+    }
+    for (uint64_t key = 0; key < 100000; ++key) { 
+        mismatches += set.Contains(key) != (model.count(key) == 1); 
+    }
+    mismatches += set.Size() != model.size(); 
+    output_stream << "DynamicFixedSet, " << kReaders << " readers and a writer: " << lookups.load()
+                  << " lookups, " << mismatches.load() << " mismatches\n"; 
+    return mismatches.load() == 0; 
+}
+
+// Build time, memory and lookup time of FixedSet<uint64_t> for 10^3, 10^4, .. max_set_size
+// random keys, without and with the prefilter. Requests hit the set with probability 0.9
+// (hit-heavy), 0.5 (mixed) and 0.1 (miss-heavy); keys are odd and misses even, so a miss is
+// never a key by accident.
+template <class HashFunctionClass>
+void RunBenchmark(const size_t max_set_size, std::ostream& output_stream) { 
+    constexpr size_t kRequestCount = 1 << 22; 
+    constexpr double kHitShares[] = {0.9, 0.5, 0.1}; 
+    output_stream << "keys\tprefilter\tbuild s\tbytes/key\t"
+                  << "ns hit-heavy\tns mixed\tns miss-heavy\n"; 
+    for (size_t set_size = 1000; set_size <= max_set_size; set_size *= 10) { 
+        std::mt19937_64 random_numbers_generator(set_size); 
+        vector<uint64_t> keys(set_size); 
+        for (auto& key : keys) { 
+            key = random_numbers_generator() | 1; 
+        }
+        vector<vector<uint64_t>> workloads; 
+        for (double hit_share : kHitShares) { 
+            std::bernoulli_distribution hit(hit_share); 
+            vector<uint64_t> requests(kRequestCount); 
+            for (auto& request : requests) { 
+                uint64_t random = random_numbers_generator(); 
+                request = hit(random_numbers_generator) ? keys[random % set_size] : random & ~1ull; 
+            }
+            workloads.push_back(std::move(requests)); 
+        }
+        for (bool prefilter : {false, true}) { 
+            FixedSet<uint64_t, HashFunctionClass> set(1); 
+            auto start = std::chrono::steady_clock::now(); 
+            set.Initialize(keys, prefilter); 
+            double build_seconds = std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - start).count(); 
+            output_stream << set_size << "\t" << (prefilter ? "yes" : "no") << "\t"
+                          << build_seconds << "\t"
+                          << static_cast<double>(set.MemoryBytes()) / set_size; 
+            for (const auto& requests : workloads) { 
+                output_stream << "\t" << MeasureLookups(set, requests); 
+            }
+            output_stream << "\n"; 
+        }
+    }
+}
+
+// Hash quality on random keys and on structured key sets which defeat weak hash functions:
+// keys differing only in a few bits of one word, in the high word only, keys whose two words
+// are equal, strings with a long common prefix and strings differing only in their length.
+// The functions are drawn after the keys are fixed, so only structure that does not depend
+// on the seed can be tried here.
+template <class HashFunctionClass>
+void RunQualityReport(std::ostream& output_stream) { 
+    constexpr size_t kSetSize = 1 << 16; 
+    constexpr uint32_t kBuilds = 32; 
+    auto make_keys = [](const size_t count, auto key_of) { 
+        vector<decltype(key_of(0))> keys; 
+        keys.reserve(count); 
+        for (size_t index = 0; index < count; ++index) { 
+            keys.push_back(key_of(index)); 
+        }
+        return keys; 
+    }; 
+    std::mt19937_64 random_numbers_generator(1); 
+    ReportKeySetQuality<uint64_t, HashFunctionClass>("random", make_keys(kSetSize,
+        [&random_numbers_generator](size_t) { return random_numbers_generator(); }),
+        kBuilds, output_stream); 
+    ReportKeySetQuality<uint64_t, HashFunctionClass>("consecutive", make_keys(kSetSize,
+        [](size_t index) { return static_cast<uint64_t>(index); }), kBuilds, output_stream); 
+    ReportKeySetQuality<uint64_t, HashFunctionClass>("stride 2^20", make_keys(kSetSize,
+        [](size_t index) { return static_cast<uint64_t>(index) << 20; }), kBuilds, output_stream); 
+    ReportKeySetQuality<uint64_t, HashFunctionClass>("high word only", make_keys(kSetSize,
+        [](size_t index) { return static_cast<uint64_t>(index) << 32; }), kBuilds, output_stream); 
+    ReportKeySetQuality<uint64_t, HashFunctionClass>("equal words", make_keys(kSetSize,
+        [](size_t index) { return index * ((static_cast<uint64_t>(1) << 32) + 1); }),
+        kBuilds, output_stream); 
+    ReportKeySetQuality<std::string, HashFunctionClass>("64-byte common prefix",
+        make_keys(kSetSize, [](size_t index) { return std::string(64, 'a') + std::to_string(index); }),
+        kBuilds, output_stream); 
+    ReportKeySetQuality<std::string, HashFunctionClass>("zero bytes of every length",
+        make_keys(1 << 12, [](size_t index) { return std::string(index, '\0'); }),
+        kBuilds, output_stream); 
+}
+
+// Average nanoseconds per set.Contains over requests.
+template <class T, class HashFunctionClass>
+double MeasureLookups(const FixedSet<T, HashFunctionClass>& set, const vector<T>& requests) { 
+    size_t found = 0; 
+    auto start = std::chrono::steady_clock::now(); 
+    for (const auto& request : requests) { 
+        found += set.Contains(KeyStorage<T>::View(request)); 
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); 
+    volatile size_t sink = found; // keeps the loop from being optimized away
+    (void)sink; 
+    return 1e9 * seconds / requests.size(); 
+}
+
+// Builds FixedSets of keys with builds different seeds and compares the builds with the
+// analysis behind kLinearCoefficient. For a universal first-level function with n buckets
+// E[sum of squared loads] < 2n, so by Markov's inequality a round is rejected with
+// probability at most 1/2 and P(more than k rounds) <= 2^-k. A second-level function on
+// c keys and c^2 slots collides with probability below 1/2, which gives the same tail.
+// A truly random first-level function spreads the loads as Poisson(1).
+template <class T, class HashFunctionClass>
+void ReportKeySetQuality(const std::string& name, const vector<T>& keys, const uint32_t builds,
+                         std::ostream& output_stream) { 
+    vector<uint64_t> first_level_rounds, second_level_rounds, loads; 
+    double ratio_sum = 0, ratio_max = 0; 
+    for (uint32_t build = 0; build < builds; ++build) { 
+        FixedSet<T, HashFunctionClass> set(build + 1); 
+        set.Initialize(keys); 
+        const BuildStatistics& statistics = set.Statistics(); 
+        AddToHistogram(first_level_rounds, statistics.first_level_attempts); 
+        for (size_t k = 0; k < statistics.attempts_histogram.size(); ++k) { 
+            AddToHistogram(second_level_rounds, k, statistics.attempts_histogram[k]); 
+        }
+        for (size_t k = 0; k < statistics.load_histogram.size(); ++k) { 
+            AddToHistogram(loads, k, statistics.load_histogram[k]); 
+        }
+        double ratio = static_cast<double>(statistics.sum_of_squares) / set.Size(); 
+        ratio_sum += ratio; 
+        ratio_max = std::max(ratio_max, ratio); 
+    }
+    output_stream << "== " << name << ": " << keys.size() << " keys, " << builds << " builds\n"
+                  << "sum of squared loads / keys of accepted rounds: mean "
+                  << ratio_sum / builds << ", max " << ratio_max << " (expected below 2, "
+                  << "rejected from " << FixedSet<T, HashFunctionClass>::kLinearCoefficient << ")\n"; 
+    // Index 0 counts empty buckets, which draw no second-level function at all.
+    auto print_tail = [&output_stream](const std::string& title, const vector<uint64_t>& rounds) { 
+        uint64_t more = std::accumulate(rounds.begin() + 1, rounds.end(), static_cast<uint64_t>(0)); 
+        const double total = more; 
+        output_stream << title << "\tk\tP(more than k)\tbound 2^-k\n"; 
+        for (size_t k = 1; k < rounds.size(); ++k) { 
+            more -= rounds[k]; 
+            output_stream << "\t" << k << "\t" << more / total << "\t" << std::ldexp(1.0, -k) << "\n"; 
+        }
+    }; 
+    print_tail("first-level rounds", first_level_rounds); 
+    print_tail("second-level rounds", second_level_rounds); 
+    const double bucket_count = std::accumulate(loads.begin(), loads.end(), static_cast<uint64_t>(0)); 
+    double poisson = std::exp(-1.0); 
+    output_stream << "bucket loads\tk\tshare\tPoisson(1)\n"; 
+    for (size_t k = 0; k < loads.size(); ++k) { 
+        output_stream << "\t" << k << "\t" << loads[k] / bucket_count << "\t" << poisson << "\n"; 
+        poisson /= k + 1; 
+    }
+}
+
+void AddToHistogram(vector<uint64_t>& histogram, const size_t value, const uint64_t count) { 
+    if (histogram.size() <= value) { 
+        histogram.resize(value + 1, 0); 
+    }
+    histogram[value] += count; 
+}
+
+template <class KeyAt, class HashFunctionClass>
+Buckets PutInBuckets(const vector<uint32_t>& indices, const KeyAt& key_at,
+                     const HashFunctionClass& function) { 
+    Buckets big_table; 
+    big_table.starts.assign(function.size() + 1, 0); 
+    vector<uint32_t> hash_codes(indices.size()); 
+    for (size_t i = 0; i < indices.size(); ++i) { 
+        hash_codes[i] = function(key_at(indices[i])); 
+        ++big_table.starts[hash_codes[i] + 1]; 
+    }
+    std::partial_sum(big_table.starts.begin(), big_table.starts.end(), big_table.starts.begin()); 
+    vector<uint32_t> positions(big_table.starts.begin(), big_table.starts.end() - 1); 
+    big_table.members.resize(indices.size()); 
+    for (size_t i = 0; i < indices.size(); ++i) { 
+        big_table.members[positions[hash_codes[i]]++] = indices[i]; 
+    }
+    return big_table; 
+}
+
+// Equal keys always share a bucket, so duplicates are dropped bucket by bucket;
+// of several equal keys the one with the smallest index is kept.
+template <class KeyAt>
+void RemoveDuplicates(Buckets& table, const KeyAt& key_at) { 
+    auto& members = table.members; 
+    uint32_t write = 0; 
+    for (size_t bucket = 0; bucket < table.Count(); ++bucket) { 
+        const uint32_t begin = table.starts[bucket]; 
+        const uint32_t end = table.starts[bucket + 1]; 
+        table.starts[bucket] = write; 
+        if (end - begin > 1) { 
+            std::sort(members.begin() + begin, members.begin() + end,
+                      [&key_at](const uint32_t first, const uint32_t second) { 
+                          auto first_key = key_at(first); 
+                          auto second_key = key_at(second); 
+                          return (first_key < second_key) ||
+                                 (first_key == second_key && first < second); 
+                      }); 
+        }
+        for (uint32_t i = begin; i < end; ++i) { 
+            if (write > table.starts[bucket] && key_at(members[write - 1]) == key_at(members[i])) { 
+                continue; 
+            }
+            members[write++] = members[i]; 
+        }
+    }
+    table.starts.back() = write; 
+    members.resize(write); 
+}
+
+// Equal residues always share a bucket, so comparing within buckets finds them all; the
+// squared bucket sizes of a first level which passed IsSquaredLengthsSumLinear keep this
+// linear.
+template <class ResidueAt>
+bool HasDistinctResidues(const Buckets& table, const ResidueAt& residue_at) { 
+    for (size_t bucket = 0; bucket < table.Count(); ++bucket) { 
+        for (uint32_t i = table.starts[bucket]; i < table.starts[bucket + 1]; ++i) { 
+            for (uint32_t j = table.starts[bucket]; j < i; ++j) { 
+                if (residue_at(table.members[i]) == residue_at(table.members[j])) { 
+                    return false; 
+                }
+            }
+        }
+    }
+    return true; 
+}
+
+// Places the members into table (a second-level range of the slot array) and reports
+// whether function is injective on them; on a collision the table is left empty again.
+template <class KeyAt, class HashFunctionClass>
+bool CheckNoCollisions(const uint32_t* members, const uint32_t count, const KeyAt& key_at,
+                       const HashFunctionClass& function, uint32_t* table) { 
+    for (uint32_t i = 0; i < count; ++i) { 
+        uint64_t hash_code = function(key_at(members[i])); 
+        if (table[hash_code] != kEmptySlot) { 
+            for (uint32_t j = 0; j < i; ++j) { 
+                table[function(key_at(members[j]))] = kEmptySlot; 
+            }
+            return false; 
+        }
+        table[hash_code] = members[i]; 
+    }
+    return true; 
+}
+
+template <class T> 
+vector<T> ReadKeys(std::istream& input_stream) { 
+    size_t num_of_keys; 
+    input_stream >> num_of_keys; 
+    vector<T> keys(num_of_keys); 
+    for (auto& key : keys) { 
+        input_stream >> key; 
+    }
+    return keys; 
+}
+
+template <class T> 
+vector<T> ReadRequests(std::istream& input_stream) { 
+    return ReadKeys<T>(input_stream); 
+}
+
+template <class T, class HashFunctionClass>
+vector<bool> MakeAnswers(const FixedSet<T, HashFunctionClass>& set,
+                         const vector<T>& requests) { 
+    vector<bool> answers; 
+    answers.reserve(requests.size()); 
+    for (const auto& request : requests) { 
+        answers.push_back(set.Contains(KeyStorage<T>::View(request))); 
+    }
+    return answers; 
+}
+
+// Stops at the first token which is not an integer in the range of T and returns the keys
+// before it.
+template <class T> 
+vector<T> ReadKeys(FastInput& input) { 
+    size_t num_of_keys = 0; 
+    if (!input.ReadInteger(num_of_keys)) { 
+        return vector<T>(); 
+    }
+    vector<T> keys(num_of_keys); 
+    for (size_t index = 0; index < num_of_keys; ++index) { 
+        if (!input.ReadInteger(keys[index])) { 
+            keys.resize(index); 
+            break; 
+        }
+    }
+    return keys; 
+}
+
+// A parser thread reads the requests in chunks, this thread looks them up and formats the
+// answers, and a writer thread hands them to output, so parsing, lookup and the blocking
+// write() overlap. Like ReadKeys it stops at the first token which is not an integer.
+template <class T, class HashFunctionClass>
+void AnswerRequests(const FixedSet<T, HashFunctionClass>& set, FastInput& input,
+                    FastOutput& output) { 
+    static constexpr size_t kChunkSize = 1 << 16; 
+    static constexpr size_t kChunksInFlight = 4; 
+    ChunkQueue<vector<T>> chunks(kChunksInFlight); 
+    std::thread parser([&input, &chunks] { 
+        size_t num_of_requests = 0; 
+        if (!input.ReadInteger(num_of_requests)) { 
+            num_of_requests = 0; 
+        }
+        while (num_of_requests > 0) { 
+            vector<T> chunk(std::min(kChunkSize, num_of_requests)); 
+            for (size_t index = 0; index < chunk.size(); ++index) { 
+                if (!input.ReadInteger(chunk[index])) { 
+                    chunk.resize(index); 
+                    num_of_requests = chunk.size(); 
+                    break; 
+                }
+            }
+            num_of_requests -= chunk.size(); 
+            chunks.Push(std::move(chunk)); 
+        }
+        chunks.Close(); 
+    }); 
+    ChunkQueue<vector<char>> answer_chunks(kChunksInFlight); 
+    std::thread writer([&output, &answer_chunks] { 
+        vector<char> answers; 
+        while (answer_chunks.Pop(answers)) { 
+            output.Write(answers.data(), answers.size()); 
+        }
+        output.Flush(); 
+    }); 
+    vector<T> chunk; 
+    while (chunks.Pop(chunk)) { 
+        vector<char> answers(4 * chunk.size()); 
+        char* position = answers.data(); 
+        for (const auto request : chunk) { 
+            if (set.Contains(request)) { 
+                std::memcpy(position, "Yes\n", 4); 
+                position += 4; 
+            } else { 
+                std::memcpy(position, "No\n", 3); 
+                position += 3; 
+            }
+        }
+        answers.resize(position - answers.data()); 
+        answer_chunks.Push(std::move(answers)); 
+    }
+    answer_chunks.Close(); 
+    parser.join(); 
+    writer.join(); 
+}
+
+void PrintAnswers(const vector<bool>& answers, std::ostream& output_stream) { 
+    for (auto answer : answers) { 
+        if (answer) {
+            output_stream << "Yes\n"; 
+        } else { 
+            output_stream << "No\n"; 
+        }
+    }
+}
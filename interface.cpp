@@ -4,6 +4,12 @@
 #include <memory>
 #include <functional>
 #include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <set>
 #include <vector>
 
 using std::vector; 
@@ -12,65 +18,216 @@ using std::make_shared;
 using std::unique_ptr; 
 using std::make_unique; 
 
-template<class charT> class ForwardAddressTable;
+// Nodes live in one arena (SuffixTree::nodes_) and refer to each other by 32-bit indices;
+// this index stands for "no node".
+constexpr uint32_t kEmptyPointer = UINT32_MAX; 
+
+template<class charT, class Alphabet> class ForwardAddressTable; 
+template<class charT> class SortedVectorTable; 
 template<class charT> class HashTable; 
+template<class charT, class LargeTable, size_t kInlineSize> class InlineAddressTable; 
 template<class charT, class AddressTable, charT sentinel> class Builder;
 template<class charT, class AddressTable, charT sentinel> class TreeVisitor; 
 template<class charT, class AddressTable, charT sentinel> class TreeIterator; 
 
+// Children of a node by the first symbol of their edges. An AddressTable returns the child
+// for a symbol (kEmptyPointer if there is none) from operator(), sets it with Assign, lists
+// all children with ForEach and tells the heap memory it holds besides itself with Bytes.
+// The static Accepts tells whether it has room for a symbol at all; Builder refuses texts
+// with symbols it has not.
+//
+// Which table suits best depends on the alphabet: ForwardAddressTable for a few symbols
+// such as DNA, AdaptiveAddressTable for texts over large alphabets, where most nodes have
+// a few children and a few nodes have very many.
+
+// The symbols a ForwardAddressTable has room for, the sentinel included. Index gives kSize
+// for a symbol outside the alphabet.
+template<class charT, charT... symbols> struct Alphabet { 
+    static constexpr size_t kSize = sizeof...(symbols); 
+    static constexpr charT kSymbols[kSize] = {symbols...}; 
+    static size_t Index(const charT symbol); 
+    static charT Symbol(const size_t index) { return kSymbols[index]; }
+    private:
+        static_assert(kSize < UINT8_MAX, "an alphabet is indexed by bytes"); 
+        static constexpr std::array<uint8_t, 1 << CHAR_BIT> MakeIndices(); 
+        static constexpr std::array<uint8_t, 1 << CHAR_BIT> kIndices = MakeIndices(); 
+}; // Alphabet
+
+typedef Alphabet<char, '$', 'A', 'C', 'G', 'T'> DnaAlphabet; 
+
+// A slot for every symbol of the alphabet: one read per lookup, but the whole alphabet is
+// paid for in every node, leaves included.
+template<class charT, class Alphabet> class ForwardAddressTable { 
+    public:
+        ForwardAddressTable() { children_.fill(kEmptyPointer); }
+        static bool Accepts(const charT symbol) { return Alphabet::Index(symbol) < Alphabet::kSize; }
+        uint32_t operator() (const charT symbol) const { 
+            size_t index = Alphabet::Index(symbol); 
+            return (index < Alphabet::kSize) ? children_[index] : kEmptyPointer; 
+        }
+        // Ignores a symbol outside the alphabet.
+        void Assign(const charT symbol, const uint32_t node) { 
+            size_t index = Alphabet::Index(symbol); 
+            if (index < Alphabet::kSize) { 
+                children_[index] = node; 
+            }
+        }
+        template<class Function> void ForEach(Function function) const; 
+        size_t Size() const { 
+            return Alphabet::kSize - std::count(children_.begin(), children_.end(), kEmptyPointer); 
+        }
+        size_t Bytes() const { return 0; }
+
+    private:
+        std::array<uint32_t, Alphabet::kSize> children_; 
+}; // ForwardAddressTable
+
+// Children sorted by symbol in one vector, found by binary search.
+template<class charT> class SortedVectorTable { 
+    public:
+        static bool Accepts(const charT) { return true; }
+        uint32_t operator() (const charT symbol) const; 
+        void Assign(const charT symbol, const uint32_t node); 
+        template<class Function> void ForEach(Function function) const { 
+            for (const auto& child : children_) { 
+                function(child.first, child.second); 
+            }
+        }
+        size_t Size() const { return children_.size(); }
+        size_t Bytes() const { return children_.capacity() * sizeof(children_[0]); }
+
+    private:
+        vector<std::pair<charT, uint32_t>> children_; 
+}; // SortedVectorTable
+
+// Open addressing with linear probing, at most half full. Leaves allocate nothing; children
+// are listed in no particular order.
+template<class charT> class HashTable { 
+    public:
+        HashTable() : size_(0), mask_(0) {}
+        static bool Accepts(const charT) { return true; }
+        uint32_t operator() (const charT symbol) const; 
+        void Assign(const charT symbol, const uint32_t node); 
+        template<class Function> void ForEach(Function function) const; 
+        size_t Size() const { return size_; }
+        size_t Bytes() const { return entries_ ? (mask_ + 1) * sizeof(Entry) : 0; }
+
+    private:
+        struct Entry { 
+            charT symbol; 
+            uint32_t node; 
+        }; 
+        static constexpr uint32_t kInitialCapacity = 4; 
+        size_t Slot(const charT symbol) const { 
+            return ((static_cast<uint64_t>(symbol) * 0x9E3779B97F4A7C15ull) >> 32) & mask_; 
+        }
+        void Grow(); 
+
+        unique_ptr<Entry[]> entries_; 
+        uint32_t size_; 
+        uint32_t mask_; 
+}; // HashTable
+
+// Keeps up to kInlineSize children inside the node itself, sorted by symbol, so most
+// nodes need no memory of their own; a node with more children moves them all to a
+// LargeTable.
+template<class charT, class LargeTable, size_t kInlineSize> class InlineAddressTable { 
+    public:
+        InlineAddressTable() : symbols_(), nodes_(), size_(0) {}
+        static bool Accepts(const charT symbol) { return LargeTable::Accepts(symbol); }
+        uint32_t operator() (const charT symbol) const; 
+        void Assign(const charT symbol, const uint32_t node); 
+        template<class Function> void ForEach(Function function) const; 
+        size_t Size() const { return large_ ? large_->Size() : size_; }
+        size_t Bytes() const { return large_ ? sizeof(LargeTable) + large_->Bytes() : 0; }
+
+    private:
+        charT symbols_[kInlineSize]; 
+        uint32_t nodes_[kInlineSize]; 
+        uint8_t size_; 
+        unique_ptr<LargeTable> large_; 
+}; // InlineAddressTable
+
+template<class charT, size_t kInlineSize = 4>
+using SortedAddressTable = InlineAddressTable<charT, SortedVectorTable<charT>, kInlineSize>; 
+// Chooses by fan-out: a few children inline, many in a hash table.
+template<class charT, size_t kInlineSize = 4>
+using AdaptiveAddressTable = InlineAddressTable<charT, HashTable<charT>, kInlineSize>; 
+
 template<class charT, class AddressTable, charT sentinel>
 class SuffixTree {
     public:
-        
+
         class Node; 
         class Location;
-        
-        SuffixTree() { root_ = make_shared<Node>(0, Node::kLastSymbolIndex); }
+
+        SuffixTree() { nodes_.push_back(Node(0, Node::kLastSymbolIndex, kEmptyPointer)); }
         SuffixTree(const SuffixTree&) = delete;
         SuffixTree& operator= (const SuffixTree&) = delete;
         ~SuffixTree() = default; // It would be generated without this line but that way we know for sure the destructor is default
 
         bool Substring(const std::basic_string<charT>& pattern) const; 
+        // Answers for many patterns at once; walks kBatchSize of them in turns, so that their
+        // cache misses overlap.
+        vector<bool> Substring(const vector<std::basic_string<charT>>& patterns) const; 
+        // Starting positions of pattern in the string, in increasing order.
+        vector<int> Occurrences(const std::basic_string<charT>& pattern) const; 
+        vector<vector<int>> Occurrences(const vector<std::basic_string<charT>>& patterns) const; 
+
+        // Documents of a generalized tree (see Builder::Append); a tree built from one string
+        // is the single document 0. Positions are in the concatenation of the documents, each
+        // followed by the sentinel.
+        uint32_t DocumentCount() const { return document_starts_.size(); }
+        int DocumentStart(const uint32_t document) const { return document_starts_[document]; }
+        uint32_t DocumentOf(const int position) const; 
+        // Documents which contain pattern, in increasing order. Walks every occurrence in all
+        // documents: O(occurrences * log(documents) + documents), with no sorting.
+        vector<uint32_t> Documents(const std::basic_string<charT>& pattern) const; 
+        // Starting positions of pattern in document, counted from the start of the document.
+        // Walks every occurrence in all documents but keeps and sorts only those in document:
+        // O(occurrences + k log k) for k occurrences in document.
+        vector<int> Occurrences(const std::basic_string<charT>& pattern, const uint32_t document) const; 
+        // The longest string which occurs in at least min_documents documents, 0 meaning all.
+        std::basic_string<charT> LongestCommonSubstring(size_t min_documents = 0) const; 
         void Traverse(TreeVisitor<charT, AddressTable, sentinel>& visitor, 
                       TreeIterator<charT, AddressTable, sentinel>& iterator) const;
-        
+        // Depth-first traversal with an explicit stack and no virtual calls: visitor.Enter(node,
+        // depth) before the children of a node and visitor.Leave(node, depth) after them, depth
+        // being the length of the string spelled from the root to the node.
+        template<class Visitor> void Traverse(Visitor& visitor) const { TraverseFrom(visitor, kRoot, 0); }
+
         typedef TreeIterator<charT, AddressTable, sentinel> Iterator; 
-        Location GiveSuffixLink(const Iterator* iterator); 
-        Location GiveDownLocation(const Iterator* iterator, const charT edge_symbol); 
-        Location GetUpLocation(const Iterator* iterator); 
-        Location GetDownNode(const Iterator* iterator, const charT edge_symbol); 
-        Location GetUpNode(const Iterator* iterator); 
+        Location GiveSuffixLink(const Iterator* iterator) const; 
+        Location GiveDownLocation(const Iterator* iterator, const charT edge_symbol) const; 
+        Location GetUpLocation(const Iterator* iterator) const; 
+        Location GetDownNode(const Iterator* iterator, const charT edge_symbol) const; 
+        Location GetUpNode(const Iterator* iterator) const; 
 
         charT operator[](const int position) const { return string_[position]; }
         int Size() const { return string_.size(); }
         bool Empty() const { return string_.empty(); }
 
-        Location Root() { return Location(root_); } 
+        Location Root() const { return Location(kRoot); }
+        const Node& GetNode(const uint32_t index) const { return nodes_[index]; }
+        size_t NodeCount() const { return nodes_.size(); }
+        // The string, the nodes and what their AddressTables keep outside them.
+        size_t MemoryBytes() const; 
+        // Position of the last symbol on the edge into node; leaf edges end with the string.
+        int EdgeEnd(const uint32_t node) const { return std::min(nodes_[node].end_, Size() - 1); }
+        int EdgeLength(const uint32_t node) const { return EdgeEnd(node) - nodes_[node].start_ + 1; }
 
+        static constexpr uint32_t kRoot = 0; 
+        static constexpr size_t kBatchSize = 16; 
 
         class Node { 
 
-                typedef SuffixTree<charT, AddressTable, sentinel>::Location Location;
-                Node() = delete; // Nodes created with use std::make_shared<Node> (...) only within Builder::Build method
-                explicit Node(const int start, const int end) : start_(start), end_(end) {}
-                explicit Node(const int start, const int end, shared_ptr<Node> parent,
-                     Location suffix_transition) : start_(start), end_(end),
-                     parent_(parent), suffix_transition_(suffix_transition) {}
-
-                Node(const Node&) = delete;
-                Node& operator= (const Node&) = delete;
-
-                shared_ptr<Node> DownNode(const charT edge_symbol) const; 
-                Location DownLocation(const charT edge_symbol) const; 
-                Location SuffixTransition() const{ return suffix_transition_; }
-                shared_ptr<Node> Parent() const { return parent_; }
-
-                bool Leaf(); 
+                explicit Node(const int start, const int end, const uint32_t parent) :
+                     start_(start), end_(end), parent_(parent), suffix_transition_(kEmptyPointer) {}
 
                 static constexpr int kLastSymbolIndex = INT_MAX;
                 int start_, end_;
-                shared_ptr<Node> parent_;
-                Location suffix_transition_;
+                uint32_t parent_; 
+                uint32_t suffix_transition_; // kEmptyPointer for leaves and the root
                 AddressTable descendants_;
 
                 friend class SuffixTree<charT, AddressTable, sentinel>; 
@@ -78,46 +235,105 @@ class SuffixTree {
 
             public:
 
-                int Start() { return start_; }
-                int End() { return end_; }
+                Node(Node&&) = default; 
+                Node& operator= (Node&&) = default; 
+
+                int Start() const { return start_; }
+                int End() const { return end_; }
+                uint32_t Parent() const { return parent_; }
+                uint32_t SuffixTransition() const { return suffix_transition_; }
+                uint32_t DownNode(const charT edge_symbol) const { return descendants_(edge_symbol); }
+                template<class Function> void ForEachChild(Function function) const { 
+                    descendants_.ForEach(function); 
+                }
+                bool Leaf() const { return descendants_.Size() == 0; }
 
         }; // Node
 
+        // A point of the tree: margin_ symbols down the edge which leaves node_ with
+        // start_symbol_, or node_ itself when margin_ is 0.
         class Location {
 
-            typedef SuffixTree<charT, AddressTable, sentinel>::Node Node;
-
-            shared_ptr<Node> node_;
+            uint32_t node_; 
             int margin_;
             charT start_symbol_;
-            
-            Location(shared_ptr<Node> node, int margin, charT start_symbol) :
-            node_(node), margin_(margin), start_symbol_(start_symbol) {}
 
-            Location(shared_ptr<Node> node) : node_(node), margin_(0) {}
-            Location() = default; 
-            
-            bool IsNode() const; 
+            Location(const uint32_t node, const int margin, const charT start_symbol) :
+            node_(node), margin_(margin), start_symbol_(start_symbol) {}
 
             friend class SuffixTree<charT, AddressTable, sentinel>; 
             friend class Builder<charT, AddressTable, sentinel>; 
 
-            public: 
+            public:
+
+                explicit Location(const uint32_t node = kEmptyPointer) :
+                node_(node), margin_(0), start_symbol_() {}
 
                 void Accept(TreeVisitor<charT, AddressTable, sentinel>& visitor) { visitor.VisitLocation(this); }
-                int Start();
-                int End();
+                bool IsNode() const { return margin_ == 0; }
+                bool Valid() const { return node_ != kEmptyPointer; }
+                // The node of the location, or the node above it if the location is on an edge.
+                uint32_t NodeIndex() const { return node_; }
+                int Margin() const { return margin_; }
+                charT EdgeSymbol() const { return start_symbol_; }
         }; //Location
 
     private:
-        
-        Location DownLocation(Location location, const charT edge_symbol) const; 
-        Location SuffixTransition(Location location) const; 
-        shared_ptr<Node> UpNode(Location location) const; 
+
+        Location DownLocation(const Location location, const charT edge_symbol) const; 
+        Location SuffixTransition(const Location location) const; 
+        uint32_t UpNode(const Location location) const; 
+        // The node at the end of the edge a location is on, or the node of the location.
+        uint32_t EdgeNode(const Location location) const; 
+        // The location length symbols below node along string_[start ..].
+        Location Rescan(uint32_t node, int start, int length) const; 
+
+        // Where a pattern ends: the node at or below its end, with the depth of that node;
+        // node is kEmptyPointer if the pattern does not occur.
+        struct Locus { 
+            uint32_t node; 
+            int depth; 
+        }; 
+        vector<Locus> FindLoci(const vector<std::basic_string<charT>>& patterns) const; 
+        template<class Visitor> void TraverseFrom(Visitor& visitor, const uint32_t node, const int depth) const; 
+        // Collects the starting positions in [begin, end) of the suffixes whose leaves it passes.
+        struct LeafCollector { 
+            void Enter(const uint32_t node, const int depth) { 
+                if (node != kRoot && tree.nodes_[node].Leaf()) { 
+                    tree.ForEachSuffix(node, depth, [this](const int start) { 
+                        if (start >= begin && start < end) { 
+                            positions.push_back(start); 
+                        }
+                    }); 
+                }
+            }
+            void Leave(const uint32_t, const int) {}
+            const SuffixTree& tree; 
+            vector<int> positions; 
+            int begin = 0; 
+            int end = INT_MAX; 
+        }; 
+        // Renumbers the nodes in depth-first preorder, so that a subtree occupies one range of
+        // the arena and traversals read it front to back. The nodes are moved to a new arena,
+        // which for a moment doubles their memory but is faster than permuting them in place.
+        void Renumber(); 
+
+        // Equal suffixes of different documents, sentinel included, end at one leaf. The leaf
+        // stands for the suffix which made it; the starts of the others are chained from
+        // shared_suffix_heads_[leaf] through shared_suffixes_.
+        struct SharedSuffix { 
+            int start; 
+            uint32_t next; 
+        }; 
+        void AddSharedSuffix(const uint32_t leaf, const int start); 
+        template<class Function> void ForEachSuffix(const uint32_t leaf, const int depth, Function function) const; 
 
         std::basic_string<charT> string_;
-        shared_ptr<Node> root_;
-        
+        vector<Node> nodes_; 
+        vector<int> document_starts_; 
+        vector<uint32_t> shared_suffix_heads_; 
+        vector<SharedSuffix> shared_suffixes_; 
+
         friend class Builder<charT, AddressTable, sentinel>;
 
 }; //SuffixTree
@@ -126,33 +342,62 @@ template<class charT, class AddressTable, charT sentinel> class Builder {
     public:
 
         typedef SuffixTree<charT, AddressTable, sentinel> Tree;
-        typedef typename Tree::Node Node; // maybe replace it before public if allowed
+        typedef typename Tree::Node Node; 
         typedef typename Tree::Location Location; 
 
         Builder() = default;
-        void Fit(std::basic_string<charT>& string);
+        // Takes the string over and appends the sentinel. A string which already contains the
+        // sentinel is refused (and left untouched): one of its suffixes could end inside the tree.
+        // So is a string with a symbol the AddressTable has no room for.
+        bool Fit(std::basic_string<charT>& string); 
+        // Ukkonen's algorithm, linear in the length of the string for a fixed alphabet.
         shared_ptr<Tree> Build();
 
+        // Online construction of a generalized suffix tree over documents which arrive in
+        // pieces. Append adds text to the open document and goes on from the active Location
+        // where the previous call stopped; FinishDocument ends the document with the sentinel
+        // and returns its number. Both take time proportional to the text they add. Text which
+        // Fit would refuse is refused here too.
+        bool Append(const std::basic_string<charT>& text); 
+        uint32_t FinishDocument(); 
+        // The tree built so far. Substring sees all the appended text; occurrence queries see
+        // the finished documents, and of the open one the suffixes which already have leaves.
+        shared_ptr<Tree> GetTree() const { return tree_; }
+
     private:
-        
+
         void MoveString(shared_ptr<Tree> suffix_tree);
-        void AssignNewEdge(shared_ptr<Node> first_node, const charT edge_symbol, shared_ptr<Node> second_node) const; 
-        shared_ptr<Node> MakeNewEdge(const int start, const int end, shared_ptr<Node> parent, Location suffix_transition) const; 
-        void MakeSuffixLink(shared_ptr<Node> node, Location suffix_transition) const; 
+        // Whether text has neither the sentinel nor symbols the AddressTable can't hold.
+        static bool Admissible(const std::basic_string<charT>& text); 
+        // Adds the suffixes ending at string position to tree_, starting from active_.
+        void Extend(const int position); 
+        // Starts the tree and the document if Append or FinishDocument finds none.
+        void OpenDocument(); 
+        int EdgeLength(const uint32_t node, const int position) const; 
+        void AssignNewEdge(const uint32_t first_node, const charT edge_symbol, const uint32_t second_node); 
+        uint32_t MakeNewEdge(const int start, const int end, const uint32_t parent); 
+        void MakeSuffixLink(const uint32_t node, const uint32_t suffix_transition); 
 
         std::basic_string<charT> string_;
+        shared_ptr<Tree> tree_; 
+        // The longest suffix which is already in the tree, and its length beyond active_.
+        Location active_; 
+        int remainder_ = 0; 
+        bool document_open_ = false; 
+        uint32_t first_document_node_ = 0; // nodes from here on were made for the open document
 
 }; //Builder
 
 template<class charT, class AddressTable, charT sentinel> class TreeVisitor { 
-    public: 
-        typedef SuffixTree<charT, AddressTable, sentinel> Tree; 
+    public:
+        typedef SuffixTree<charT, AddressTable, sentinel> Tree;
         typedef typename Tree::Location Location; 
 
         virtual void VisitLocation(Location* location) = 0; 
-        
+
         explicit TreeVisitor(shared_ptr<Tree> suffix_tree) : suffix_tree_(suffix_tree) {}
         TreeVisitor() = default; 
+        virtual ~TreeVisitor() = default; 
         TreeVisitor& operator= (const TreeVisitor&) = delete; 
         TreeVisitor (const TreeVisitor&) = delete; 
 
@@ -164,130 +409,1237 @@ template<class charT, class AddressTable, charT sentinel> class TreeVisitor {
 template<class charT, class AddressTable, charT sentinel> class TreeIterator { 
     public:
 
-        typedef SuffixTree<charT, AddressTable, sentinel> Tree; 
+        typedef SuffixTree<charT, AddressTable, sentinel> Tree;
         typedef typename Tree::Location Location; 
 
         TreeIterator(shared_ptr<Tree> suffix_tree, Location location) : suffix_tree_(suffix_tree), current_location_(location) {}
         TreeIterator(shared_ptr<Tree> suffix_tree) : TreeIterator(suffix_tree, suffix_tree->Root()) {}
-        
+        virtual ~TreeIterator() = default; 
+
         virtual void Next() = 0; 
         virtual void Previous() = 0; 
 
-        bool IsValid() const{ return current_location_.empty(); }
-        
-        void ExamineNode(TreeVisitor<charT, AddressTable, sentinel>& visitor) const{ current_location_->Accept(visitor); }
+        bool IsValid() const{ return current_location_.Valid(); }
+
+        void ExamineNode(TreeVisitor<charT, AddressTable, sentinel>& visitor) const{ 
+            Location location = current_location_; 
+            location.Accept(visitor); 
+        }
         Location CurrentLocation() const{ return current_location_; }
-        
+
     protected: 
 
-        Location GetSuffixLink(); 
-        Location GetDownLocation(charT edge_symbol); 
-        Location GetUpLocation(); 
-        Location GetDownNode(charT edge_symbol); 
-        Location GetUpNode(); 
+        Location GetSuffixLink() const { return suffix_tree_->GiveSuffixLink(this); }
+        Location GetDownLocation(charT edge_symbol) const { return suffix_tree_->GiveDownLocation(this, edge_symbol); }
+        Location GetUpLocation() const { return suffix_tree_->GetUpLocation(this); }
+        Location GetDownNode(charT edge_symbol) const { return suffix_tree_->GetDownNode(this, edge_symbol); }
+        Location GetUpNode() const { return suffix_tree_->GetUpNode(this); }
 
         shared_ptr<Tree> suffix_tree_; 
         Location current_location_; 
 
 }; // Iterator
 
-/*
-int main() {
+// Goes through the nodes in depth-first preorder, the children of a node in the order its
+// AddressTable lists them. Previous steps back through the nodes already passed.
+template<class charT, class AddressTable, charT sentinel>
+class DepthFirstIterator : public TreeIterator<charT, AddressTable, sentinel> { 
+    public:
+
+        typedef SuffixTree<charT, AddressTable, sentinel> Tree;
+        typedef typename Tree::Location Location; 
+
+        explicit DepthFirstIterator(shared_ptr<Tree> suffix_tree) :
+            TreeIterator<charT, AddressTable, sentinel>(suffix_tree), visited_(1, Tree::kRoot), position_(0) {}
+
+        void Next() override; 
+        void Previous() override; 
+
+    private:
+
+        vector<uint32_t> pending_; // nodes still to visit, the next one on top
+        vector<uint32_t> visited_; 
+        size_t position_; // of the current node in visited_, visited_.size() past the end
+
+}; // DepthFirstIterator
+
+template<class charT, class AddressTable, charT sentinel>
+void BenchmarkAddressTable(const std::string& text_name, const std::string& table_name,
+                           const std::basic_string<charT>& text,
+                           const vector<std::basic_string<charT>>& patterns, std::ostream& output_stream); 
+template<class charT>
+vector<std::basic_string<charT>> MakePatterns(const std::basic_string<charT>& text, const charT first_symbol,
+                                              const int alphabet_size, std::mt19937& random_numbers_generator); 
+void RunBenchmark(const int length, std::ostream& output_stream); 
+template<class charT, class AddressTable, charT sentinel>
+size_t CheckAddressTable(const std::string& table_name, const std::basic_string<charT>& alphabet,
+                         const charT foreign_symbol, std::mt19937& random_numbers_generator,
+                         std::ostream& output_stream); 
+template<class charT>
+vector<int> FindAll(const std::basic_string<charT>& text, const std::basic_string<charT>& pattern); 
+bool RunCheck(std::ostream& output_stream); 
+
+// Reads a text and then patterns, one per word, and tells for every pattern whether it
+// occurs in the text.
+// --common: reads documents, one per word, and prints their longest common substring;
+// --check: compares the queries of every AddressTable with brute force on small random texts;
+// --benchmark [length]: build and Substring() times of every AddressTable on random texts.
+int main(int argc, char* argv[]) { 
+    std::ios_base::sync_with_stdio(false); 
+    if (argc > 1 && std::string(argv[1]) == "--check") { 
+        return RunCheck(std::cout) ? 0 : 1; 
+    }
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") { 
+        const int length = (argc > 2) ? std::stoi(argv[2]) : 10000000; 
+        if (length < 1) { 
+            std::cerr << "The benchmark text length must be positive\n"; 
+            return 1; 
+        }
+        RunBenchmark(length, std::cout); 
+        return 0; 
+    }
+    if (argc > 1 && std::string(argv[1]) == "--common") { 
+        Builder<char, AdaptiveAddressTable<char>, '$'> builder; 
+        std::string document; 
+        while (std::cin >> document) { 
+            if (!builder.Append(document)) { 
+                std::cerr << "Documents must not contain '$'\n"; 
+                return 1; 
+            }
+            builder.FinishDocument(); 
+        }
+        auto suffix_tree = builder.GetTree(); 
+        std::cout << (suffix_tree ? suffix_tree->LongestCommonSubstring() : std::string()) << "\n"; 
+        return 0; 
+    }
     std::string string;
     std::cin >> string;
 
-    Builder<char, ForwardAddressTable<char>, '$'> builder_first;
-    builder.Fit(string);
-    auto suffix_tree_forward_addressing = builder_first.Build();
-    Builder<char, HashTable<char>, '$'> builder_second;
-    auto suffix_tree_hash_tables = builder_second.Build();
+    Builder<char, AdaptiveAddressTable<char>, '$'> builder; 
+    if (!builder.Fit(string)) { 
+        std::cerr << "The text must not contain '$'\n"; 
+        return 1; 
+    }
+    auto suffix_tree = builder.Build(); 
+    vector<std::string> patterns; 
+    std::string pattern; 
+    while (std::cin >> pattern) { 
+        patterns.push_back(std::move(pattern)); 
+    }
+    for (bool answer : suffix_tree->Substring(patterns)) { 
+        std::cout << (answer ? "Yes\n" : "No\n"); 
+    }
     return 0;
 }
 
+template<class charT, charT... symbols>
+size_t Alphabet<charT, symbols...>::Index(const charT symbol) { 
+    if (sizeof(charT) == 1) { 
+        return kIndices[static_cast<unsigned char>(symbol)]; 
+    }
+    return std::find(kSymbols, kSymbols + kSize, symbol) - kSymbols; 
+}
+
+template<class charT, charT... symbols>
+constexpr std::array<uint8_t, 1 << CHAR_BIT> Alphabet<charT, symbols...>::MakeIndices() { 
+    std::array<uint8_t, 1 << CHAR_BIT> indices{}; 
+    for (auto& index : indices) { 
+        index = kSize; 
+    }
+    for (size_t index = 0; index < kSize; ++index) { 
+        indices[static_cast<unsigned char>(kSymbols[index])] = index; 
+    }
+    return indices; 
+}
+
+template<class charT, class Alphabet> template<class Function>
+void ForwardAddressTable<charT, Alphabet>::ForEach(Function function) const { 
+    for (size_t index = 0; index < Alphabet::kSize; ++index) { 
+        if (children_[index] != kEmptyPointer) { 
+            function(Alphabet::Symbol(index), children_[index]); 
+        }
+    }
+}
+
+template<class charT>
+uint32_t SortedVectorTable<charT>::operator() (const charT symbol) const { 
+    auto child = std::lower_bound(children_.begin(), children_.end(), symbol,
+                                  [](const std::pair<charT, uint32_t>& entry, const charT key) { 
+                                      return entry.first < key; 
+                                  }); 
+    return (child != children_.end() && child->first == symbol) ? child->second : kEmptyPointer; 
+}
+
+template<class charT>
+void SortedVectorTable<charT>::Assign(const charT symbol, const uint32_t node) { 
+    auto child = std::lower_bound(children_.begin(), children_.end(), symbol,
+                                  [](const std::pair<charT, uint32_t>& entry, const charT key) { 
+                                      return entry.first < key; 
+                                  }); 
+    if (child != children_.end() && child->first == symbol) { 
+        child->second = node; 
+    } else { 
+        children_.insert(child, std::make_pair(symbol, node)); 
+    }
+}
+
+template<class charT>
+uint32_t HashTable<charT>::operator() (const charT symbol) const { 
+    if (!entries_) { 
+        return kEmptyPointer; 
+    }
+    for (size_t slot = Slot(symbol); entries_[slot].node != kEmptyPointer; slot = (slot + 1) & mask_) { 
+        if (entries_[slot].symbol == symbol) { 
+            return entries_[slot].node; 
+        }
+    }
+    return kEmptyPointer; 
+}
+
+template<class charT>
+void HashTable<charT>::Assign(const charT symbol, const uint32_t node) { 
+    for (size_t slot = Slot(symbol); entries_ && entries_[slot].node != kEmptyPointer; slot = (slot + 1) & mask_) { 
+        if (entries_[slot].symbol == symbol) { 
+            entries_[slot].node = node; 
+            return; 
+        }
+    }
+    if (2 * (size_ + 1) > (entries_ ? mask_ + 1 : 0)) { 
+        Grow(); 
+    }
+    size_t slot = Slot(symbol); 
+    while (entries_[slot].node != kEmptyPointer) { 
+        slot = (slot + 1) & mask_; 
+    }
+    entries_[slot] = Entry{symbol, node}; 
+    ++size_; 
+}
+
+template<class charT> template<class Function>
+void HashTable<charT>::ForEach(Function function) const { 
+    for (size_t slot = 0; entries_ && slot <= mask_; ++slot) { 
+        if (entries_[slot].node != kEmptyPointer) { 
+            function(entries_[slot].symbol, entries_[slot].node); 
+        }
+    }
+}
+
+template<class charT>
+void HashTable<charT>::Grow() { 
+    const uint32_t capacity = entries_ ? 2 * (mask_ + 1) : kInitialCapacity; 
+    unique_ptr<Entry[]> entries = std::move(entries_); 
+    const uint32_t old_capacity = entries ? mask_ + 1 : 0; 
+    entries_.reset(new Entry[capacity]); 
+    for (uint32_t slot = 0; slot < capacity; ++slot) { 
+        entries_[slot].node = kEmptyPointer; 
+    }
+    mask_ = capacity - 1; 
+    size_ = 0; 
+    for (uint32_t slot = 0; slot < old_capacity; ++slot) { 
+        if (entries[slot].node != kEmptyPointer) { 
+            Assign(entries[slot].symbol, entries[slot].node); 
+        }
+    }
+}
+
+template<class charT, class LargeTable, size_t kInlineSize>
+uint32_t InlineAddressTable<charT, LargeTable, kInlineSize>::operator() (const charT symbol) const { 
+    if (large_) { 
+        return (*large_)(symbol); 
+    }
+    for (uint8_t index = 0; index < size_; ++index) { 
+        if (symbols_[index] == symbol) { 
+            return nodes_[index]; 
+        }
+    }
+    return kEmptyPointer; 
+}
+
+template<class charT, class LargeTable, size_t kInlineSize>
+void InlineAddressTable<charT, LargeTable, kInlineSize>::Assign(const charT symbol, const uint32_t node) { 
+    if (large_) { 
+        large_->Assign(symbol, node); 
+        return; 
+    }
+    uint8_t position = std::lower_bound(symbols_, symbols_ + size_, symbol) - symbols_; 
+    if (position < size_ && symbols_[position] == symbol) { 
+        nodes_[position] = node; 
+        return; 
+    }
+    if (size_ == kInlineSize) { 
+        large_ = make_unique<LargeTable>(); 
+        for (uint8_t index = 0; index < size_; ++index) { 
+            large_->Assign(symbols_[index], nodes_[index]); 
+        }
+        large_->Assign(symbol, node); 
+        return; 
+    }
+    std::copy_backward(symbols_ + position, symbols_ + size_, symbols_ + size_ + 1); 
+    std::copy_backward(nodes_ + position, nodes_ + size_, nodes_ + size_ + 1); 
+    symbols_[position] = symbol; 
+    nodes_[position] = node; 
+    ++size_; 
+}
+
+template<class charT, class LargeTable, size_t kInlineSize> template<class Function>
+void InlineAddressTable<charT, LargeTable, kInlineSize>::ForEach(Function function) const { 
+    if (large_) { 
+        large_->ForEach(function); 
+        return; 
+    }
+    for (uint8_t index = 0; index < size_; ++index) { 
+        function(symbols_[index], nodes_[index]); 
+    }
+}
+
 template<class charT, class AddressTable, charT sentinel>
-void Builder<charT, AddressTable, sentinel>::Fit(std::basic_string<charT>& string) {
+size_t SuffixTree<charT, AddressTable, sentinel>::MemoryBytes() const { 
+    size_t bytes = string_.capacity() * sizeof(charT) + nodes_.capacity() * sizeof(Node) +
+                   document_starts_.capacity() * sizeof(int) + shared_suffix_heads_.capacity() * sizeof(uint32_t) +
+                   shared_suffixes_.capacity() * sizeof(SharedSuffix); 
+    for (const auto& node : nodes_) { 
+        bytes += node.descendants_.Bytes(); 
+    }
+    return bytes; 
+}
 
-    string_ = (string.find(sentinel) == string.npos) ? std::move(string.append(1, sentinel)) : std::basic_string<charT>();
-    // maybe not the best decision to leave empty string if sentinel encountered in input string, but it is very easy to implement.
-    // good way to handle this problem is to create class-shell for symbols where would be bool member labeling if the symbol is
-    // sentinel, but this would lead to many additional code, so here we left it as it is.
+template<class charT, class AddressTable, charT sentinel>
+bool SuffixTree<charT, AddressTable, sentinel>::Substring(const std::basic_string<charT>& pattern) const { 
+    Location location = Root(); 
+    for (size_t index = 0; index < pattern.size() && location.Valid(); ++index) { 
+        location = DownLocation(location, pattern[index]); 
+    }
+    return location.Valid(); 
+}
 
+template<class charT, class AddressTable, charT sentinel>
+vector<bool> SuffixTree<charT, AddressTable, sentinel>::Substring(const vector<std::basic_string<charT>>& patterns) const { 
+    vector<Locus> loci = FindLoci(patterns); 
+    vector<bool> answers(patterns.size()); 
+    for (size_t index = 0; index < patterns.size(); ++index) { 
+        answers[index] = (loci[index].node != kEmptyPointer); 
+    }
+    return answers; 
 }
 
-template<class charT, class AddressTable, charT sentinel> //something should be done with those vast signatures
-void Builder<charT, AddressTable, sentinel>::MoveString(shared_ptr<SuffixTree<charT, AddressTable, sentinel>> suffix_tree) {  
-    suffix_tree.string_ = std::move(string_);             
+template<class charT, class AddressTable, charT sentinel>
+vector<int> SuffixTree<charT, AddressTable, sentinel>::Occurrences(const std::basic_string<charT>& pattern) const { 
+    return std::move(Occurrences(vector<std::basic_string<charT>>(1, pattern))[0]); 
 }
 
 template<class charT, class AddressTable, charT sentinel>
-shared_ptr<SuffixTree<charT, AddressTable, sentinel>> Builder<charT, AddressTable, sentinel>::Build() {
+vector<vector<int>> SuffixTree<charT, AddressTable, sentinel>::Occurrences(
+                                        const vector<std::basic_string<charT>>& patterns) const { 
+    vector<Locus> loci = FindLoci(patterns); 
+    vector<vector<int>> occurrences(patterns.size()); 
+    for (size_t index = 0; index < patterns.size(); ++index) { 
+        if (loci[index].node == kEmptyPointer) { 
+            continue; 
+        }
+        LeafCollector collector{*this, {}}; 
+        TraverseFrom(collector, loci[index].node, loci[index].depth); 
+        std::sort(collector.positions.begin(), collector.positions.end()); 
+        occurrences[index] = std::move(collector.positions); 
+    }
+    return occurrences; 
+}
 
-    auto suffix_tree = make_shared<Tree>();
-    auto root = suffix_tree->root_;
-
-    Builder.MoveString(suffix_tree); 
-    auto& string = suffix_tree->string_;
-    //moving string forward to its destination
-    
-    std::function<shared_ptr<Node>(charT)> function = root->descendants_; 
-    // Proving if the AddressTable is valid
-
-    charT default_char;
-    Location current_location(root, 0, default_char)
-    // Initial location is always a Node, but in process of lifting up the tree
-    // it can turn into an edge location.
-
-    for (int index = 0; index < string.size(); ++index) {
-        charT last_symbol = string[index];
-        if (current_location.node_ == root) {
-            if(root->DownNode(last_symbol).node_ != AddressTable::kEmptyPointer) {
-                //kEmptyPointer must be public
-                current_location = root->DownLocation(last_symbol)
-            } else {
-                AssignNewEdge(root, last_symbol, MakeNewNode(index, Node::kLastSymbolIndex, root, Location(root, 0, default_char))); 
+template<class charT, class AddressTable, charT sentinel>
+uint32_t SuffixTree<charT, AddressTable, sentinel>::DocumentOf(const int position) const { 
+    return std::upper_bound(document_starts_.begin(), document_starts_.end(), position) - document_starts_.begin() - 1; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+vector<uint32_t> SuffixTree<charT, AddressTable, sentinel>::Documents(const std::basic_string<charT>& pattern) const { 
+    struct DocumentMarker { 
+        void Enter(const uint32_t node, const int depth) { 
+            if (node != kRoot && tree.nodes_[node].Leaf()) { 
+                tree.ForEachSuffix(node, depth, [this](const int start) { contains[tree.DocumentOf(start)] = true; }); 
             }
-            continue;
         }
+        void Leave(const uint32_t, const int) {}
+        const SuffixTree& tree; 
+        vector<bool> contains; 
+    }; 
+    const Locus locus = FindLoci(vector<std::basic_string<charT>>(1, pattern))[0]; 
+    vector<uint32_t> documents; 
+    if (locus.node == kEmptyPointer) { 
+        return documents; 
+    }
+    DocumentMarker marker{*this, vector<bool>(DocumentCount(), false)}; 
+    TraverseFrom(marker, locus.node, locus.depth); 
+    for (uint32_t document = 0; document < DocumentCount(); ++document) { 
+        if (marker.contains[document]) { 
+            documents.push_back(document); 
+        }
+    }
+    return documents; 
+}
 
-        shared_ptr<Node> previous_node;
-        while(current_location.node_->Leaf()) {
-            previous_node = current_location.node_;
-            current_location = previous_node->suffix_transition_;
+template<class charT, class AddressTable, charT sentinel>
+vector<int> SuffixTree<charT, AddressTable, sentinel>::Occurrences(const std::basic_string<charT>& pattern,
+                                                                   const uint32_t document) const { 
+    const Locus locus = FindLoci(vector<std::basic_string<charT>>(1, pattern))[0]; 
+    if (locus.node == kEmptyPointer) { 
+        return vector<int>(); 
+    }
+    const int start = document_starts_[document]; 
+    const int end = (document + 1 < DocumentCount()) ? document_starts_[document + 1] : Size(); 
+    LeafCollector collector{*this, {}, start, end}; 
+    TraverseFrom(collector, locus.node, locus.depth); 
+    std::sort(collector.positions.begin(), collector.positions.end()); 
+    for (auto& position : collector.positions) { 
+        position -= start; 
+    }
+    return std::move(collector.positions); 
+}
+
+// One traversal which keeps a bitset of documents for every node on the current path, so it
+// takes O(nodes * documents / 64) time. A string common to several documents ends at a node,
+// or, if it is a suffix of all of them, on the edge of a shared leaf just before the sentinel.
+template<class charT, class AddressTable, charT sentinel>
+std::basic_string<charT> SuffixTree<charT, AddressTable, sentinel>::LongestCommonSubstring(size_t min_documents) const { 
+    struct DocumentCounter { 
+        void Enter(const uint32_t node, const int depth) { 
+            sets.resize(sets.size() + words, 0); 
+            starts.push_back(0); 
+            if (node != kRoot && tree.nodes_[node].Leaf()) { 
+                tree.ForEachSuffix(node, depth, [this](const int start) { 
+                    uint32_t document = tree.DocumentOf(start); 
+                    sets[sets.size() - words + document / 64] |= static_cast<uint64_t>(1) << (document % 64); 
+                    starts.back() = start; 
+                }); 
+            }
         }
-          
-        while (Tree::DownLocation(current_location, last_symbol) == Location::kInvalidTransition) { 
-            shared_ptr<Node> current_node; 
-            if (!current_location.IsNode()) { 
-                auto son = Tree::DownNode(current_location, last_symbol); // If Location is on the edge last_symbol ignored
-                int new_start = son->start_;
-                int new_end = new_start + current_location.margin_ - 1;
-                son->start_ = new_end + 1;
-                shared_ptr<Node> parent = current_location.node_;
+        void Leave(const uint32_t node, const int depth) { 
+            const size_t set = sets.size() - words; 
+            size_t documents = 0; 
+            for (size_t word = 0; word < words; ++word) { 
+                documents += __builtin_popcountll(sets[set + word]); 
+            }
+            int length = depth; 
+            if (node != kRoot && tree.nodes_[node].Leaf() && tree.string_[tree.EdgeEnd(node)] == sentinel) { 
+                --length; 
+            }
+            if (documents >= min_documents && length > best_length) { 
+                best_length = length; 
+                best_start = starts.back(); 
+            }
+            if (starts.size() > 1) { 
+                for (size_t word = 0; word < words; ++word) { 
+                    sets[set - words + word] |= sets[set + word]; 
+                }
+                starts[starts.size() - 2] = starts.back(); 
+            }
+            sets.resize(set); 
+            starts.pop_back(); 
+        }
+        const SuffixTree& tree; 
+        const size_t words; 
+        const size_t min_documents; 
+        vector<uint64_t> sets; 
+        vector<int> starts; // of some suffix below each node on the path
+        int best_length; 
+        int best_start; 
+    }; 
+    DocumentCounter counter{*this, (DocumentCount() + 63) / 64,
+                            (min_documents == 0) ? DocumentCount() : min_documents, {}, {}, 0, 0}; 
+    Traverse(counter); 
+    return string_.substr(counter.best_start, counter.best_length); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void SuffixTree<charT, AddressTable, sentinel>::AddSharedSuffix(const uint32_t leaf, const int start) { 
+    if (shared_suffix_heads_.size() <= leaf) { 
+        shared_suffix_heads_.resize(std::max<size_t>(nodes_.capacity(), leaf + 1), kEmptyPointer); 
+    }
+    shared_suffixes_.push_back(SharedSuffix{start, shared_suffix_heads_[leaf]}); 
+    shared_suffix_heads_[leaf] = shared_suffixes_.size() - 1; 
+}
+
+template<class charT, class AddressTable, charT sentinel> template<class Function>
+void SuffixTree<charT, AddressTable, sentinel>::ForEachSuffix(const uint32_t leaf, const int depth,
+                                                              Function function) const { 
+    function(EdgeEnd(leaf) + 1 - depth); 
+    if (leaf >= shared_suffix_heads_.size()) { 
+        return; 
+    }
+    for (uint32_t index = shared_suffix_heads_[leaf]; index != kEmptyPointer; index = shared_suffixes_[index].next) { 
+        function(shared_suffixes_[index].start); 
+    }
+}
 
-                current_node = MakeNewNode(new_start, new_end, parent, Location()); 
+// Each walk goes a whole edge at a time in three turns: look the child up and prefetch it,
+// read where its edge starts and prefetch that part of the string, compare the edge. A finished
+// walk hands its place over to the next pattern.
+template<class charT, class AddressTable, charT sentinel>
+vector<typename SuffixTree<charT, AddressTable, sentinel>::Locus>
+SuffixTree<charT, AddressTable, sentinel>::FindLoci(const vector<std::basic_string<charT>>& patterns) const { 
+    struct Walk { 
+        size_t pattern; 
+        int position; // in the pattern, of the first symbol of the edge to child
+        uint32_t node; 
+        uint32_t child; 
+        int depth; // of node
+        int stage; 
+    }; 
+    vector<Locus> loci(patterns.size(), Locus{kEmptyPointer, 0}); 
+    Walk walks[kBatchSize]; 
+    size_t next_pattern = 0; 
+    size_t active = 0; 
+    for (; active < kBatchSize && next_pattern < patterns.size(); ++active) { 
+        walks[active] = Walk{next_pattern++, 0, kRoot, kEmptyPointer, 0, 0}; 
+    }
+    while (active > 0) { 
+        for (size_t index = 0; index < active; ++index) { 
+            Walk& walk = walks[index]; 
+            const auto& pattern = patterns[walk.pattern]; 
+            bool finished = false; 
+            if (walk.stage == 1) { 
+                __builtin_prefetch(string_.data() + nodes_[walk.child].start_); 
+                walk.stage = 2; 
+                continue; 
+            }
+            if (walk.stage == 2) { 
+                const int start = nodes_[walk.child].start_; 
+                const int length = EdgeLength(walk.child); 
+                const int compared = std::min<int>(length, pattern.size() - walk.position); 
+                int offset = 1; // the first symbol was matched by the lookup
+                while (offset < compared && string_[start + offset] == pattern[walk.position + offset]) { 
+                    ++offset; 
+                }
+                if (offset < compared) { 
+                    finished = true; 
+                } else if (compared < length || walk.position + length == static_cast<int>(pattern.size())) { 
+                    loci[walk.pattern] = Locus{walk.child, walk.depth + length}; 
+                    finished = true; 
+                } else { 
+                    walk.node = walk.child; 
+                    walk.depth += length; 
+                    walk.position += length; 
+                    walk.stage = 0; 
+                }
+            }
+            if (!finished && walk.stage == 0) { 
+                if (walk.position == static_cast<int>(pattern.size())) { 
+                    loci[walk.pattern] = Locus{walk.node, walk.depth}; 
+                    finished = true; 
+                } else { 
+                    walk.child = nodes_[walk.node].descendants_(pattern[walk.position]); 
+                    finished = (walk.child == kEmptyPointer); 
+                    if (!finished) { 
+                        __builtin_prefetch(&nodes_[walk.child]); 
+                        walk.stage = 1; 
+                    }
+                }
+            }
+            if (!finished) { 
+                continue; 
+            }
+            if (next_pattern < patterns.size()) { 
+                walk = Walk{next_pattern++, 0, kRoot, kEmptyPointer, 0, 0}; 
             } else { 
-                current_node = current_location.node_; 
+                walk = walks[--active]; 
+                --index; 
             }
-            
-            current_location = Tree::SuffixTransition(current_location);  
+        }
+    }
+    return loci; 
+}
+
+template<class charT, class AddressTable, charT sentinel> template<class Visitor>
+void SuffixTree<charT, AddressTable, sentinel>::TraverseFrom(Visitor& visitor, const uint32_t node,
+                                                             const int depth) const { 
+    struct Frame { 
+        uint32_t node; 
+        int depth; // of the parent when entering, of the node itself when leaving
+        bool leaving; 
+    }; 
+    vector<Frame> stack(1, Frame{node, depth, false}); 
+    while (!stack.empty()) { 
+        const Frame frame = stack.back(); 
+        stack.pop_back(); 
+        if (frame.leaving) { 
+            visitor.Leave(frame.node, frame.depth); 
+            continue; 
+        }
+        const int node_depth = (frame.node == node) ? depth : frame.depth + EdgeLength(frame.node); 
+        visitor.Enter(frame.node, node_depth); 
+        if (nodes_[frame.node].Leaf()) { 
+            visitor.Leave(frame.node, node_depth); 
+            continue; 
+        }
+        stack.push_back(Frame{frame.node, node_depth, true}); 
+        const size_t first_child = stack.size(); 
+        nodes_[frame.node].descendants_.ForEach([&stack, node_depth](charT, uint32_t child) { 
+            stack.push_back(Frame{child, node_depth, false}); 
+        }); 
+        std::reverse(stack.begin() + first_child, stack.end()); 
+    }
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void SuffixTree<charT, AddressTable, sentinel>::Renumber() { 
+    vector<uint32_t> new_index(nodes_.size()); 
+    vector<Node> renumbered_nodes; 
+    renumbered_nodes.reserve(nodes_.size()); 
+    vector<uint32_t> stack(1, kRoot); 
+    while (!stack.empty()) { 
+        uint32_t node = stack.back(); 
+        stack.pop_back(); 
+        new_index[node] = renumbered_nodes.size(); 
+        const size_t first_child = stack.size(); 
+        nodes_[node].descendants_.ForEach([&stack](charT, uint32_t child) { stack.push_back(child); }); 
+        std::reverse(stack.begin() + first_child, stack.end()); 
+        renumbered_nodes.push_back(std::move(nodes_[node])); 
+    }
+    nodes_.swap(renumbered_nodes); 
+    renumbered_nodes = vector<Node>(); 
+    auto renumbered = [&new_index](const uint32_t node) { 
+        return (node == kEmptyPointer) ? kEmptyPointer : new_index[node]; 
+    }; 
+    vector<std::pair<charT, uint32_t>> children; 
+    for (auto& node : nodes_) { 
+        node.parent_ = renumbered(node.parent_); 
+        node.suffix_transition_ = renumbered(node.suffix_transition_); 
+        children.clear(); 
+        node.descendants_.ForEach([&children](charT symbol, uint32_t child) { children.emplace_back(symbol, child); }); 
+        for (const auto& child : children) { 
+            node.descendants_.Assign(child.first, new_index[child.second]); 
+        }
+    }
+    if (!shared_suffix_heads_.empty()) { 
+        shared_suffix_heads_.resize(new_index.size(), kEmptyPointer); 
+        vector<uint32_t> heads(new_index.size()); 
+        for (size_t node = 0; node < new_index.size(); ++node) { 
+            heads[new_index[node]] = shared_suffix_heads_[node]; 
+        }
+        shared_suffix_heads_.swap(heads); 
+    }
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void SuffixTree<charT, AddressTable, sentinel>::Traverse(TreeVisitor<charT, AddressTable, sentinel>& visitor,
+                                                         TreeIterator<charT, AddressTable, sentinel>& iterator) const { 
+    for (; iterator.IsValid(); iterator.Next()) { 
+        iterator.ExamineNode(visitor); 
+    }
+}
+
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::GiveSuffixLink(const Iterator* iterator) const { 
+    return SuffixTransition(iterator->CurrentLocation()); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::GiveDownLocation(const Iterator* iterator, const charT edge_symbol) const { 
+    return DownLocation(iterator->CurrentLocation(), edge_symbol); 
+}
+
+// One symbol up; the root has nothing above it.
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::GetUpLocation(const Iterator* iterator) const { 
+    Location location = iterator->CurrentLocation(); 
+    if (!location.IsNode()) { 
+        return (location.margin_ == 1) ? Location(location.node_) :
+               Location(location.node_, location.margin_ - 1, location.start_symbol_); 
+    }
+    if (location.node_ == kRoot) { 
+        return Location(); 
+    }
+    const Node& node = nodes_[location.node_]; 
+    int length = EdgeLength(location.node_); 
+    return (length == 1) ? Location(node.parent_) :
+           Location(node.parent_, length - 1, string_[node.start_]); 
+}
+
+// The node at the end of the edge of edge_symbol, or of the edge the location is on
+// (edge_symbol is then ignored).
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::GetDownNode(const Iterator* iterator, const charT edge_symbol) const { 
+    Location location = iterator->CurrentLocation(); 
+    if (location.IsNode()) { 
+        return Location(nodes_[location.node_].descendants_(edge_symbol)); 
+    }
+    return Location(EdgeNode(location)); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::GetUpNode(const Iterator* iterator) const { 
+    return Location(UpNode(iterator->CurrentLocation())); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::DownLocation(const Location location, const charT edge_symbol) const { 
+    if (!location.Valid()) { 
+        return Location(); 
+    }
+    uint32_t child; 
+    int margin; 
+    if (location.IsNode()) { 
+        child = nodes_[location.node_].descendants_(edge_symbol); 
+        if (child == kEmptyPointer) { 
+            return Location(); 
+        }
+        margin = 1; 
+    } else { 
+        child = EdgeNode(location); 
+        if (string_[nodes_[child].start_ + location.margin_] != edge_symbol) { 
+            return Location(); 
+        }
+        margin = location.margin_ + 1; 
+    }
+    if (margin == EdgeLength(child)) { 
+        return Location(child); 
+    }
+    return Location(location.node_, margin, string_[nodes_[child].start_]); 
+}
+
+// The location of the same string without its first symbol; the root has none.
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::SuffixTransition(const Location location) const { 
+    if (!location.Valid() || (location.node_ == kRoot && location.IsNode())) { 
+        return Location(); 
+    }
+    if (location.IsNode() && nodes_[location.node_].suffix_transition_ != kEmptyPointer) { 
+        return Location(nodes_[location.node_].suffix_transition_); 
+    }
+    // A leaf, or a point on an edge: follow the link of the node above and rescan the rest.
+    uint32_t upper_node = location.node_; 
+    int start, length; 
+    if (location.IsNode()) { 
+        upper_node = nodes_[location.node_].parent_; 
+        start = nodes_[location.node_].start_; 
+        length = EdgeLength(location.node_); 
+    } else { 
+        start = nodes_[EdgeNode(location)].start_; 
+        length = location.margin_; 
+    }
+    if (upper_node == kRoot) { 
+        return Rescan(kRoot, start + 1, length - 1); 
+    }
+    return Rescan(nodes_[upper_node].suffix_transition_, start, length); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+uint32_t SuffixTree<charT, AddressTable, sentinel>::UpNode(const Location location) const { 
+    if (!location.Valid()) { 
+        return kEmptyPointer; 
+    }
+    return location.IsNode() ? nodes_[location.node_].parent_ : location.node_; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+uint32_t SuffixTree<charT, AddressTable, sentinel>::EdgeNode(const Location location) const { 
+    return location.IsNode() ? location.node_ : nodes_[location.node_].descendants_(location.start_symbol_); 
+}
+
+// Skips whole edges by their lengths, so it costs one step per node passed.
+template<class charT, class AddressTable, charT sentinel>
+typename SuffixTree<charT, AddressTable, sentinel>::Location
+SuffixTree<charT, AddressTable, sentinel>::Rescan(uint32_t node, int start, int length) const { 
+    while (length > 0) { 
+        uint32_t child = nodes_[node].descendants_(string_[start]); 
+        int edge_length = EdgeLength(child); 
+        if (length < edge_length) { 
+            return Location(node, length, string_[start]); 
+        }
+        node = child; 
+        start += edge_length; 
+        length -= edge_length; 
+    }
+    return Location(node); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+bool Builder<charT, AddressTable, sentinel>::Fit(std::basic_string<charT>& string) { 
+    if (!Admissible(string)) { 
+        return false; 
+    }
+    string_ = std::move(string.append(1, sentinel)); 
+    return true; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+bool Builder<charT, AddressTable, sentinel>::Admissible(const std::basic_string<charT>& text) { 
+    return AddressTable::Accepts(sentinel) && text.find(sentinel) == text.npos &&
+           std::all_of(text.begin(), text.end(), [](const charT symbol) { return AddressTable::Accepts(symbol); }); 
+}
+
+template<class charT, class AddressTable, charT sentinel> //something should be done with those vast signatures
+void Builder<charT, AddressTable, sentinel>::MoveString(shared_ptr<SuffixTree<charT, AddressTable, sentinel>> suffix_tree) {  
+    suffix_tree->string_ = std::move(string_); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+shared_ptr<SuffixTree<charT, AddressTable, sentinel>> Builder<charT, AddressTable, sentinel>::Build() {
+    tree_ = make_shared<Tree>(); 
+    MoveString(tree_); 
+    // A string of n symbols ending with the sentinel has n leaves and, besides the root, at
+    // most n - 1 internal nodes, so the arena never reallocates during the build.
+    tree_->nodes_.reserve(2 * tree_->string_.size()); 
+    active_ = tree_->Root(); 
+    remainder_ = 0; 
+    for (int position = 0; position < tree_->Size(); ++position) { 
+        Extend(position); 
+    }
+    tree_->nodes_.shrink_to_fit(); 
+    tree_->Renumber(); 
+    tree_->document_starts_.assign(1, 0); 
+    return std::move(tree_); 
+}
 
-            AssignNewEdge(current_node, last_symbol, MakeNewNode(index, Node::kLastSymbolIndex, current_node, Location())); 
+template<class charT, class AddressTable, charT sentinel>
+bool Builder<charT, AddressTable, sentinel>::Append(const std::basic_string<charT>& text) { 
+    if (!Admissible(text)) { 
+        return false; 
+    }
+    OpenDocument(); 
+    int position = tree_->Size(); 
+    tree_->string_.append(text); 
+    for (; position < tree_->Size(); ++position) { 
+        Extend(position); 
+    }
+    return true; 
+}
+
+// The sentinel makes every pending suffix of the document explicit (see Extend), after which
+// the active Location is back at the root for the next document.
+template<class charT, class AddressTable, charT sentinel>
+uint32_t Builder<charT, AddressTable, sentinel>::FinishDocument() { 
+    OpenDocument(); 
+    tree_->string_.push_back(sentinel); 
+    const int last_position = tree_->Size() - 1; 
+    Extend(last_position); 
+    auto& nodes = tree_->nodes_; 
+    for (uint32_t node = first_document_node_; node < nodes.size(); ++node) { 
+        if (nodes[node].end_ == Node::kLastSymbolIndex) { 
+            nodes[node].end_ = last_position; 
+        }
+    }
+    document_open_ = false; 
+    return tree_->DocumentCount() - 1; 
+}
 
-            MakeSuffixLink(previous_node, current_node);   // Using conversion constructor Location(shared_ptr<Node>)
+template<class charT, class AddressTable, charT sentinel>
+void Builder<charT, AddressTable, sentinel>::OpenDocument() { 
+    if (!tree_) { 
+        tree_ = make_shared<Tree>(); 
+        active_ = tree_->Root(); 
+        remainder_ = 0; 
+        document_open_ = false; 
+    }
+    if (!document_open_) { 
+        tree_->document_starts_.push_back(tree_->Size()); 
+        first_document_node_ = tree_->nodes_.size(); 
+        document_open_ = true; 
+    }
+}
 
-            if (previous_node()) {     // the same as previous_node == AddressTable::kEmptyPointer but brief 
-                MakeSuffixLink(previous_node->DownNode(last_symbol), current_node->DownNode(last_symbol)); 
+// One phase of Ukkonen's algorithm. remainder_ suffixes, the longest first, still have to get
+// leaves; each either gets one (splitting an edge if needed) or is found to be in the tree
+// already, and then so are all the shorter ones. Between two suffixes active_ moves by a suffix
+// link, which keeps the whole construction linear.
+template<class charT, class AddressTable, charT sentinel>
+void Builder<charT, AddressTable, sentinel>::Extend(const int position) { 
+    auto& nodes = tree_->nodes_; // nodes are only ever indexed, as MakeNewEdge can move them
+    const auto& string = tree_->string_; 
+    const charT last_symbol = string[position]; 
+    uint32_t previous_node = kEmptyPointer; // the last split node, which waits for its suffix link
+    ++remainder_; 
+    while (remainder_ > 0) { 
+        if (active_.margin_ == 0) { 
+            active_.start_symbol_ = last_symbol; 
+        }
+        uint32_t son = nodes[active_.node_].descendants_(active_.start_symbol_); 
+        if (son == kEmptyPointer) { 
+            AssignNewEdge(active_.node_, last_symbol, MakeNewEdge(position, Node::kLastSymbolIndex, active_.node_)); 
+            MakeSuffixLink(previous_node, active_.node_); 
+            previous_node = kEmptyPointer; 
+        } else { 
+            int length = EdgeLength(son, position); 
+            if (active_.margin_ >= length) { 
+                active_.node_ = son; 
+                active_.margin_ -= length; 
+                active_.start_symbol_ = string[position - active_.margin_]; 
+                continue; 
             }
+            if (string[nodes[son].start_ + active_.margin_] == last_symbol) { 
+                MakeSuffixLink(previous_node, active_.node_); 
+                if (last_symbol != sentinel) { 
+                    ++active_.margin_; 
+                    break; 
+                }
+                // The same suffix of an earlier document: the sentinels of different documents
+                // stand apart, so the suffix is not pending but gets a place at that leaf.
+                tree_->AddSharedSuffix(son, position - remainder_ + 1); 
+                previous_node = kEmptyPointer; 
+            } else { 
+                const int new_start = nodes[son].start_; 
+                const int new_end = new_start + active_.margin_ - 1; 
+                uint32_t current_node = MakeNewEdge(new_start, new_end, active_.node_); 
+                AssignNewEdge(active_.node_, active_.start_symbol_, current_node); 
+                nodes[son].start_ = new_end + 1; 
+                nodes[son].parent_ = current_node; 
+                AssignNewEdge(current_node, string[new_end + 1], son); 
+                AssignNewEdge(current_node, last_symbol, MakeNewEdge(position, Node::kLastSymbolIndex, current_node)); 
+                MakeSuffixLink(previous_node, current_node); 
+                previous_node = current_node; 
+            }
+        }
+        --remainder_; 
+        if (active_.node_ == Tree::kRoot && active_.margin_ > 0) { 
+            --active_.margin_; 
+            active_.start_symbol_ = string[position - remainder_ + 1]; 
+        } else if (active_.node_ != Tree::kRoot) { 
+            uint32_t suffix_transition = nodes[active_.node_].suffix_transition_; 
+            active_.node_ = (suffix_transition == kEmptyPointer) ? Tree::kRoot : suffix_transition; 
+        }
+    }
+}
+
+template<class charT, class AddressTable, charT sentinel>
+int Builder<charT, AddressTable, sentinel>::EdgeLength(const uint32_t node, const int position) const { 
+    const Node& son = tree_->nodes_[node]; 
+    return std::min(son.end_, position) - son.start_ + 1; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void Builder<charT, AddressTable, sentinel>::AssignNewEdge(const uint32_t first_node, const charT edge_symbol,
+                                                           const uint32_t second_node) { 
+    tree_->nodes_[first_node].descendants_.Assign(edge_symbol, second_node); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+uint32_t Builder<charT, AddressTable, sentinel>::MakeNewEdge(const int start, const int end, const uint32_t parent) { 
+    tree_->nodes_.push_back(Node(start, end, parent)); 
+    return tree_->nodes_.size() - 1; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void Builder<charT, AddressTable, sentinel>::MakeSuffixLink(const uint32_t node, const uint32_t suffix_transition) { 
+    if (node != kEmptyPointer) { 
+        tree_->nodes_[node].suffix_transition_ = suffix_transition; 
+    }
+}
 
-            previous_node = current_node;
+template<class charT, class AddressTable, charT sentinel>
+void DepthFirstIterator<charT, AddressTable, sentinel>::Next() { 
+    if (!this->IsValid()) { 
+        return; 
+    }
+    if (position_ + 1 < visited_.size()) { 
+        this->current_location_ = Location(visited_[++position_]); 
+        return; 
+    }
+    const size_t first_child = pending_.size(); 
+    this->suffix_tree_->GetNode(visited_[position_]).ForEachChild([this](charT, uint32_t child) { 
+        pending_.push_back(child); 
+    }); 
+    std::reverse(pending_.begin() + first_child, pending_.end()); 
+    ++position_; 
+    if (pending_.empty()) { 
+        this->current_location_ = Location(); 
+        return; 
+    }
+    visited_.push_back(pending_.back()); 
+    pending_.pop_back(); 
+    this->current_location_ = Location(visited_.back()); 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void DepthFirstIterator<charT, AddressTable, sentinel>::Previous() { 
+    if (position_ > 0) { 
+        this->current_location_ = Location(visited_[--position_]); 
+    }
+}
+
+// Random texts over four, 26 and 4096 symbols, each built with every AddressTable which
+// suits its alphabet and queried with random substrings of the text and random strings.
+void RunBenchmark(const int length, std::ostream& output_stream) { 
+    typedef Alphabet<char, '$', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+                     'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'> LowercaseAlphabet; 
+    std::mt19937 random_numbers_generator(1); 
+    output_stream << "text\ttable\tbuild ns/symbol\tbytes/symbol\tns/Substring\tbatched\n"; 
+
+    std::string dna(length, 0); 
+    for (auto& symbol : dna) { 
+        symbol = "ACGT"[random_numbers_generator() % 4]; 
+    }
+    auto dna_patterns = MakePatterns(dna, 'A', 0, random_numbers_generator); 
+    BenchmarkAddressTable<char, ForwardAddressTable<char, DnaAlphabet>, '$'>("dna", "forward", dna, dna_patterns, output_stream); 
+    BenchmarkAddressTable<char, SortedAddressTable<char>, '$'>("dna", "sorted", dna, dna_patterns, output_stream); 
+    BenchmarkAddressTable<char, HashTable<char>, '$'>("dna", "hash", dna, dna_patterns, output_stream); 
+    BenchmarkAddressTable<char, AdaptiveAddressTable<char>, '$'>("dna", "adaptive", dna, dna_patterns, output_stream); 
+
+    std::string letters(length, 0); 
+    for (auto& symbol : letters) { 
+        symbol = 'a' + random_numbers_generator() % 26; 
+    }
+    auto letter_patterns = MakePatterns(letters, 'a', 26, random_numbers_generator); 
+    BenchmarkAddressTable<char, ForwardAddressTable<char, LowercaseAlphabet>, '$'>("letters", "forward", letters,
+                                                                                  letter_patterns, output_stream); 
+    BenchmarkAddressTable<char, SortedAddressTable<char>, '$'>("letters", "sorted", letters, letter_patterns, output_stream); 
+    BenchmarkAddressTable<char, HashTable<char>, '$'>("letters", "hash", letters, letter_patterns, output_stream); 
+    BenchmarkAddressTable<char, AdaptiveAddressTable<char>, '$'>("letters", "adaptive", letters, letter_patterns, output_stream); 
+
+    std::u32string symbols(length, 0); 
+    for (auto& symbol : symbols) { 
+        symbol = 1 + random_numbers_generator() % 4096; 
+    }
+    auto symbol_patterns = MakePatterns(symbols, U'\1', 4096, random_numbers_generator); 
+    BenchmarkAddressTable<char32_t, SortedAddressTable<char32_t>, U'\0'>("4096 symbols", "sorted", symbols,
+                                                                        symbol_patterns, output_stream); 
+    BenchmarkAddressTable<char32_t, HashTable<char32_t>, U'\0'>("4096 symbols", "hash", symbols,
+                                                               symbol_patterns, output_stream); 
+    BenchmarkAddressTable<char32_t, AdaptiveAddressTable<char32_t>, U'\0'>("4096 symbols", "adaptive", symbols,
+                                                                          symbol_patterns, output_stream); 
+}
+
+// Half of the patterns are substrings of text, the others random strings of the same
+// lengths (4 .. 19, but no longer than text) over the alphabet of alphabet_size symbols
+// from first_symbol.
+template<class charT>
+vector<std::basic_string<charT>> MakePatterns(const std::basic_string<charT>& text, const charT first_symbol,
+                                              const int alphabet_size, std::mt19937& random_numbers_generator) { 
+    constexpr int kPatternCount = 1 << 20; 
+    vector<std::basic_string<charT>> patterns(kPatternCount); 
+    for (int index = 0; index < kPatternCount; ++index) { 
+        int length = std::min<int>(4 + random_numbers_generator() % 16, text.size()); 
+        if (index % 2 == 0) { 
+            patterns[index] = text.substr(random_numbers_generator() % (text.size() - length + 1), length); 
+            continue; 
+        }
+        for (int position = 0; position < length; ++position) { 
+            int symbol = random_numbers_generator() % (alphabet_size ? alphabet_size : 4); 
+            patterns[index].push_back(alphabet_size ? first_symbol + symbol : "ACGT"[symbol]); 
         }
+    }
+    return patterns; 
+}
+
+template<class charT, class AddressTable, charT sentinel>
+void BenchmarkAddressTable(const std::string& text_name, const std::string& table_name,
+                           const std::basic_string<charT>& text,
+                           const vector<std::basic_string<charT>>& patterns, std::ostream& output_stream) { 
+    std::basic_string<charT> string = text; 
+    Builder<charT, AddressTable, sentinel> builder; 
+    builder.Fit(string); 
+    auto start = std::chrono::steady_clock::now(); 
+    auto suffix_tree = builder.Build(); 
+    double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); 
+    size_t found = 0; 
+    start = std::chrono::steady_clock::now(); 
+    for (const auto& pattern : patterns) { 
+        found += suffix_tree->Substring(pattern); 
+    }
+    double query_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); 
+    start = std::chrono::steady_clock::now(); 
+    vector<bool> answers = suffix_tree->Substring(patterns); 
+    double batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); 
+    found += std::count(answers.begin(), answers.end(), true); 
+    volatile size_t sink = found; // keeps the queries from being optimized away
+    (void)sink; 
+    output_stream << text_name << "\t" << table_name << "\t" << 1e9 * build_seconds / text.size() << "\t"
+                  << static_cast<double>(suffix_tree->MemoryBytes()) / text.size() << "\t"
+                  << 1e9 * query_seconds / patterns.size() << "\t" << 1e9 * batch_seconds / patterns.size() << "\n"; 
+}
 
-        MakeSuffixLink(previous_node, current_location); 
-        current_location = Tree::DownLocation(current_location, last_symbol); 
-        if (previous_node()) {     
-            MakeSuffixLink(previous_node->DownNode(last_symbol), current_location); 
+// Returns whether every table passed; each reports its own number of mismatches.
+bool RunCheck(std::ostream& output_stream) { 
+    typedef Alphabet<char, '$', 'a', 'b', 'c'> CheckAlphabet; 
+    std::mt19937 random_numbers_generator(1); 
+    const std::string alphabet = "abc"; 
+    size_t mismatches = 0; 
+    mismatches += CheckAddressTable<char, ForwardAddressTable<char, CheckAlphabet>, '$'>(
+                      "forward", alphabet, 'N', random_numbers_generator, output_stream); 
+    mismatches += CheckAddressTable<char, SortedVectorTable<char>, '$'>(
+                      "sorted vector", alphabet, 'N', random_numbers_generator, output_stream); 
+    mismatches += CheckAddressTable<char, HashTable<char>, '$'>(
+                      "hash", alphabet, 'N', random_numbers_generator, output_stream); 
+    mismatches += CheckAddressTable<char, SortedAddressTable<char>, '$'>(
+                      "sorted", alphabet, 'N', random_numbers_generator, output_stream); 
+    mismatches += CheckAddressTable<char, AdaptiveAddressTable<char>, '$'>(
+                      "adaptive", alphabet, 'N', random_numbers_generator, output_stream); 
+    return mismatches == 0; 
+}
+
+// Every starting position of pattern in text; the empty pattern starts at every symbol.
+template<class charT>
+vector<int> FindAll(const std::basic_string<charT>& text, const std::basic_string<charT>& pattern) { 
+    vector<int> positions; 
+    for (size_t position = 0; position < text.size() && position + pattern.size() <= text.size(); ++position) { 
+        if (text.compare(position, pattern.size(), pattern) == 0) { 
+            positions.push_back(position); 
         }
     }
+    return positions; 
 }
 
-*/
+// Texts of up to 40 symbols over one to all symbols of alphabet, built at once, and sets of
+// up to 6 documents appended a few symbols at a time. Patterns are substrings of the text and
+// random strings, some of them ending with the sentinel; the tree shape is checked through
+// the number of its leaves and of the distinct substrings its edges spell. Some texts get
+// foreign_symbol, outside alphabet, which tables without room for it must refuse, as
+// ForwardAddressTable<char, DnaAlphabet> must refuse the 'N' of real DNA.
+template<class charT, class AddressTable, charT sentinel>
+size_t CheckAddressTable(const std::string& table_name, const std::basic_string<charT>& alphabet,
+                         const charT foreign_symbol, std::mt19937& random_numbers_generator,
+                         std::ostream& output_stream) { 
+    typedef SuffixTree<charT, AddressTable, sentinel> Tree; 
+    constexpr int kRounds = 1000; 
+    constexpr int kPatternsPerRound = 40; 
+    auto random_text = [&](const size_t max_length, const size_t symbols) { 
+        std::basic_string<charT> text(random_numbers_generator() % (max_length + 1), 0); 
+        for (auto& symbol : text) { 
+            symbol = alphabet[random_numbers_generator() % symbols]; 
+        }
+        return text; 
+    }; 
+    auto random_pattern = [&](const std::basic_string<charT>& text, const size_t symbols) { 
+        std::basic_string<charT> pattern = random_text(5, symbols); 
+        if (random_numbers_generator() % 2 == 0 && !text.empty()) { 
+            pattern = text.substr(random_numbers_generator() % text.size(), pattern.size()); 
+        }
+        if (random_numbers_generator() % 8 == 0) { 
+            pattern.push_back(sentinel); 
+        }
+        return pattern; 
+    }; 
+    struct ShapeCounter { 
+        void Enter(const uint32_t node, const int) { 
+            ++nodes; 
+            if (node == Tree::kRoot) { 
+                return; 
+            }
+            bool leaf = tree.GetNode(node).Leaf(); 
+            leaves += leaf; 
+            substrings += tree.EdgeLength(node) - leaf; // the sentinel is no substring
+        }
+        void Leave(const uint32_t, const int) {}
+        const Tree& tree; 
+        size_t nodes; 
+        size_t leaves; 
+        size_t substrings; 
+    }; 
+    size_t mismatches = 0; 
+    for (int round = 0; round < kRounds; ++round) { 
+        const size_t symbols = 1 + random_numbers_generator() % alphabet.size(); 
+        std::basic_string<charT> text = random_text(40, symbols); 
+        if (round % 8 == 0 && !text.empty()) { 
+            text[random_numbers_generator() % text.size()] = foreign_symbol; 
+        }
+        std::basic_string<charT> string = text; 
+        Builder<charT, AddressTable, sentinel> builder; 
+        const bool fitted = builder.Fit(string); 
+        mismatches += fitted != (text.find(foreign_symbol) == text.npos || AddressTable::Accepts(foreign_symbol)) ||
+                      Builder<charT, AddressTable, sentinel>().Append(text) != fitted; 
+        if (!fitted) { 
+            continue; 
+        }
+        auto suffix_tree = builder.Build(); 
+        const std::basic_string<charT> terminated = text + sentinel; 
+        std::set<std::basic_string<charT>> substrings; 
+        for (size_t start = 0; start < text.size(); ++start) { 
+            for (size_t length = 1; start + length <= text.size(); ++length) { 
+                substrings.insert(text.substr(start, length)); 
+            }
+        }
+        ShapeCounter counter{*suffix_tree, 0, 0, 0}; 
+        suffix_tree->Traverse(counter); 
+        mismatches += counter.nodes != suffix_tree->NodeCount() || counter.leaves != text.size() + 1 ||
+                      counter.substrings != substrings.size(); 
+        vector<std::basic_string<charT>> patterns; 
+        for (int index = 0; index < kPatternsPerRound; ++index) { 
+            patterns.push_back(random_pattern(text, symbols)); 
+        }
+        vector<bool> found = suffix_tree->Substring(patterns); 
+        vector<vector<int>> occurrences = suffix_tree->Occurrences(patterns); 
+        for (size_t index = 0; index < patterns.size(); ++index) { 
+            vector<int> expected = FindAll(terminated, patterns[index]); 
+            mismatches += suffix_tree->Substring(patterns[index]) != !expected.empty() ||
+                          found[index] != !expected.empty() ||
+                          suffix_tree->Occurrences(patterns[index]) != expected || occurrences[index] != expected; 
+        }
+    }
+    for (int round = 0; round < kRounds; ++round) { 
+        const size_t symbols = 1 + random_numbers_generator() % alphabet.size(); 
+        const uint32_t document_count = random_numbers_generator() % 7; 
+        Builder<charT, AddressTable, sentinel> builder; 
+        vector<std::basic_string<charT>> documents; 
+        std::basic_string<charT> concatenation; 
+        for (uint32_t document = 0; document < document_count; ++document) { 
+            documents.push_back(random_text(12, symbols)); 
+            const auto& text = documents.back(); 
+            for (size_t start = 0; start < text.size(); ) { 
+                const size_t length = 1 + random_numbers_generator() % 4; 
+                builder.Append(text.substr(start, length)); 
+                start += length; 
+                const auto appended = text.substr(0, start); 
+                const auto piece = appended.substr(random_numbers_generator() % appended.size()); 
+                mismatches += !builder.GetTree()->Substring(piece); 
+            }
+            mismatches += builder.FinishDocument() != document; 
+            concatenation += text + sentinel; 
+        }
+        auto suffix_tree = builder.GetTree(); 
+        if (!suffix_tree) { 
+            mismatches += document_count != 0; 
+            continue; 
+        }
+        mismatches += suffix_tree->DocumentCount() != document_count || suffix_tree->Size() != static_cast<int>(concatenation.size()); 
+        for (int index = 0; index < kPatternsPerRound; ++index) { 
+            const auto pattern = random_pattern(concatenation, symbols); 
+            const size_t sentinel_position = pattern.find(sentinel); 
+            if (sentinel_position != pattern.npos && sentinel_position + 1 != pattern.size()) { 
+                continue; // no path of the tree goes from one document into the next
+            }
+            vector<int> expected = FindAll(concatenation, pattern); 
+            vector<uint32_t> expected_documents; 
+            for (int position : expected) { 
+                uint32_t document = suffix_tree->DocumentOf(position); 
+                if (expected_documents.empty() || expected_documents.back() != document) { 
+                    expected_documents.push_back(document); 
+                }
+            }
+            mismatches += suffix_tree->Occurrences(pattern) != expected ||
+                          suffix_tree->Documents(pattern) != expected_documents; 
+            for (uint32_t document = 0; document < document_count; ++document) { 
+                mismatches += suffix_tree->Occurrences(pattern, document) !=
+                              FindAll(documents[document] + sentinel, pattern); 
+            }
+        }
+        for (size_t min_documents = 0; min_documents <= document_count; ++min_documents) { 
+            const size_t needed = min_documents ? min_documents : document_count; 
+            auto count_documents = [&documents](const std::basic_string<charT>& string) { 
+                size_t count = 0; 
+                for (const auto& document : documents) { 
+                    count += document.find(string) != document.npos; 
+                }
+                return count; 
+            }; 
+            size_t longest = 0; 
+            for (const auto& document : documents) { 
+                for (size_t start = 0; start < document.size(); ++start) { 
+                    for (size_t length = longest + 1; start + length <= document.size(); ++length) { 
+                        if (count_documents(document.substr(start, length)) < needed) { 
+                            break; 
+                        }
+                        longest = length; 
+                    }
+                }
+            }
+            const auto common = suffix_tree->LongestCommonSubstring(min_documents); 
+            mismatches += common.size() != longest || count_documents(common) < needed; 
+        }
+    }
+    output_stream << table_name << ": " << mismatches << " mismatches\n"; 
+    return mismatches; 
+}